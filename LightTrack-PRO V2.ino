@@ -3,26 +3,38 @@
 #include <WebServer.h>
 #include <FastLED.h>
 #include <EEPROM.h>
+#include <Preferences.h>
 #include <SPIFFS.h>
 #include <math.h>
 #include "esp_wifi.h"
 #include <time.h> // Used for time management
 #include <ArduinoOTA.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "esp_pm.h"
+#ifdef LED_OUTPUT_RMT
+#include "driver/rmt.h"
+#endif
+#include "LightTrackCommon.h"
+#include "LightTrackRender.h"
+#include "LightTrackSettings.h"
+#ifdef RENDER_SNAPSHOTS
+#include "LightTrackSnapshots.h"
+#endif
+#ifdef RENDER_BENCHMARK
+#include "LightTrackBenchmark.h"
+#endif
 
 // ------------------------- LED Configuration -------------------------
-#define LED_PIN             2
-#define NUM_LEDS            300
-#define CHIPSET             WS2812B
-#define COLOR_ORDER         GRB
+// Pins, strip length, power model and sensor ranges: LightTrackCommon.h
 CRGB leds[NUM_LEDS];
-
-// ------------------------- Sensor Parameters -------------------------
-#define SENSOR_HEADER       0xAA
-#define MIN_DISTANCE        20
-#define MAX_DISTANCE        1000
-#define DEFAULT_DISTANCE    1000
-#define NOISE_THRESHOLD     5
+// FastLED's TypicalLEDStrip. Folded into the colour pipeline instead of
+// applied at output, so low background levels are corrected before dithering.
+const uint8_t ledColorCorrection[3] = { 0xFF, 0xB0, 0xF0 };
 
 // ------------------------- Display Parameters -------------------------
 int updateInterval = 20;
@@ -34,6 +46,13 @@ int additionalLEDs = 0;
 CRGB baseColor = CRGB(255, 200, 50);
 int ledOffDelay = 5;
 int gradientSoftness = 7; // Gradient configuration
+uint16_t powerBudgetMa = 4000; // Strip current limit, 0 = unlimited
+uint8_t effectIndex = 0;       // Active entry of effectRegistry[]
+uint8_t maxBeams = 1;          // Simultaneous beams, 1..MAX_TARGETS
+uint16_t lookAheadMs = 0;      // Extend the beam head by this much travel at the tracked speed, 0 = off
+uint8_t colorGammaTenths = 10; // Gamma of picked colours x10, 10 = used as raw duty (no curve)
+uint16_t colorKelvin = 6500;   // White balance; 6500 K is neutral
+CRGB whitePoint = CRGB(255, 255, 255); // Per-install channel gains for this strip batch
 
 // Global sensor distance
 volatile unsigned int g_sensorDistance = DEFAULT_DISTANCE;
@@ -55,111 +74,574 @@ volatile int clientTimezoneOffsetMinutes = 0; // Client offset from UTC in minut
 volatile bool isTimeOffsetSet = false;       // Flag indicating offset has been set
 // -------------------------------------------------
 
+// ------------------------- Output Segments -------------------------
+// Each segment drives leds[start .. start+count-1] from its own pin. With the
+// RMT backend all segments transmit in parallel, so refresh time follows the
+// longest segment. The FastLED backend always drives one segment on LED_PIN.
+OutputSegment outputSegments[MAX_OUTPUT_SEGMENTS] = { { LED_PIN, 0, NUM_LEDS } };
+uint8_t outputSegmentCount = 1;
+
+// Parses "pin:start:count,pin:start:count"
+bool parseSegmentLayout(const String& text, OutputSegment* segments, uint8_t& count) {
+  char buf[64];
+  text.toCharArray(buf, sizeof(buf));
+  count = 0;
+  char* savePtr = NULL;
+  for (char* item = strtok_r(buf, ",", &savePtr); item; item = strtok_r(NULL, ",", &savePtr)) {
+    unsigned int pin, start, length;
+    if (count >= MAX_OUTPUT_SEGMENTS || sscanf(item, "%u:%u:%u", &pin, &start, &length) != 3) return false;
+    segments[count].pin = pin;
+    segments[count].start = start;
+    segments[count].count = length;
+    count++;
+  }
+  return isValidSegmentLayout(segments, count);
+}
+
+String formatSegmentLayout(const OutputSegment* segments = outputSegments, uint8_t count = outputSegmentCount) {
+  String text = "";
+  for (int i = 0; i < count; i++) {
+    if (i > 0) text += ",";
+    text += segments[i].pin; text += ":";
+    text += segments[i].start; text += ":";
+    text += segments[i].count;
+  }
+  return text;
+}
+
+// ------------------------- Pixel Map -------------------------
+// The render works on a straight logical strip (index 0 nearest the sensor).
+// pixelMap[] sends every logical pixel to its physical LED. It is built from
+// runs of physical indices listed in logical order: a run with first > last
+// is laid out reversed, and physical LEDs not covered by any run stay dark.
+// A gap run (first == PIXEL_GAP, last = length) stands for a stretch of the
+// path with no strip fitted, such as a doorway: it keeps its logical slots so
+// the beam stays in step with the sensor distance across it, but those slots
+// map to PIXEL_GAP and are never output. Uncovered physical LEDs, by
+// contrast, take up no logical slots at all.
+PixelRun pixelRuns[MAX_MAP_RUNS] = { { 0, NUM_LEDS - 1 } };
+uint8_t pixelRunCount = 1;
+
+CRGB logicalLeds[MAX_LOGICAL_LEDS];  // Render target, logicalLedCount pixels used
+uint16_t pixelMap[MAX_LOGICAL_LEDS]; // Logical index -> physical index in leds[], or PIXEL_GAP
+int logicalLedCount = NUM_LEDS;
+volatile bool pixelMapChanged = true; // Rebuilt by the LED task before its next frame
+
+void rebuildPixelMap() {
+  pixelMapChanged = false;
+  int logical = 0;
+  for (int r = 0; r < pixelRunCount; r++) {
+    if (isGapRun(pixelRuns[r])) {
+      for (int n = 0; n < pixelRuns[r].last && logical < MAX_LOGICAL_LEDS; n++) pixelMap[logical++] = PIXEL_GAP;
+      continue;
+    }
+    int step = (pixelRuns[r].last >= pixelRuns[r].first) ? 1 : -1;
+    for (int p = pixelRuns[r].first; logical < MAX_LOGICAL_LEDS; p += step) {
+      pixelMap[logical++] = p;
+      if (p == pixelRuns[r].last) break;
+    }
+  }
+  logicalLedCount = logical;
+  fill_solid(leds, NUM_LEDS, CRGB::Black); // Skipped pixels are never written again
+}
+
+// Parses "0-99,gap40,199-100,250" (a single index is a one-pixel run, gapN
+// keeps N logical pixels with no LED behind them)
+bool parsePixelRuns(const String& text, PixelRun* runs, uint8_t& count) {
+  char buf[96];
+  text.toCharArray(buf, sizeof(buf));
+  count = 0;
+  char* savePtr = NULL;
+  for (char* item = strtok_r(buf, ",", &savePtr); item; item = strtok_r(NULL, ",", &savePtr)) {
+    unsigned int first, last;
+    if (count >= MAX_MAP_RUNS) return false;
+    if (sscanf(item, "gap%u", &last) == 1) {
+      if (last > MAX_LOGICAL_LEDS) return false;
+      runs[count].first = PIXEL_GAP;
+      runs[count].last = last;
+      count++;
+      continue;
+    }
+    int fields = sscanf(item, "%u-%u", &first, &last);
+    if (fields < 1 || first >= PIXEL_GAP) return false;
+    runs[count].first = first;
+    runs[count].last = (fields == 2) ? last : first;
+    count++;
+  }
+  return isValidPixelRuns(runs, count);
+}
+
+String formatPixelRuns(const PixelRun* runs = pixelRuns, uint8_t count = pixelRunCount) {
+  String text = "";
+  for (int i = 0; i < count; i++) {
+    if (i > 0) text += ",";
+    if (isGapRun(runs[i])) { text += "gap"; text += runs[i].last; continue; }
+    text += runs[i].first;
+    if (runs[i].last != runs[i].first) { text += "-"; text += runs[i].last; }
+  }
+  return text;
+}
+
+// ------------------------- Transitions -------------------------
+// Beam, background and schedule changes fade instead of cutting. ledTask
+// watches for the edges itself and runs one Fader per layer; each frame a
+// fader yields a single 1/256 level that scales that layer's colour, so a
+// fade costs a table lookup per frame and nothing per pixel.
+#define TRANSITION_LUT_STEPS 64
+
+// TransitionEvent, TransitionSetting and TransitionCurve are in
+// LightTrackRender.h, since the render constants carry the settings to ledTask;
+// TRANSITION_MAX_MS is with the settings checks in LightTrackSettings.h
+const char* const transitionEventNames[TRANSITION_EVENT_COUNT] = { "beamAppear", "beamTimeout", "schedule", "background" };
+
+const char* const transitionCurveNames[CURVE_COUNT] = { "linear", "easeIn", "easeOut", "easeInOut" };
+
+const TransitionSetting defaultTransitions[TRANSITION_EVENT_COUNT] = {
+  { 300, CURVE_EASE_OUT }, { 1500, CURVE_EASE_IN_OUT }, { 3000, CURVE_EASE_IN_OUT }, { 800, CURVE_LINEAR }
+};
+TransitionSetting transitionSettings[TRANSITION_EVENT_COUNT] = {
+  { 300, CURVE_EASE_OUT }, { 1500, CURVE_EASE_IN_OUT }, { 3000, CURVE_EASE_IN_OUT }, { 800, CURVE_LINEAR }
+};
+
+// easingLut[curve][step]: progress in 1/256 after step/TRANSITION_LUT_STEPS of the duration
+uint16_t easingLut[CURVE_COUNT][TRANSITION_LUT_STEPS + 1];
+
+void buildEasingLut() {
+  for (int i = 0; i <= TRANSITION_LUT_STEPS; i++) {
+    float t = (float)i / TRANSITION_LUT_STEPS;
+    easingLut[CURVE_LINEAR][i] = (uint16_t)(t * 256.0f + 0.5f);
+    easingLut[CURVE_EASE_IN][i] = (uint16_t)(t * t * 256.0f + 0.5f);
+    easingLut[CURVE_EASE_OUT][i] = (uint16_t)((1.0f - (1.0f - t) * (1.0f - t)) * 256.0f + 0.5f);
+    easingLut[CURVE_EASE_IN_OUT][i] = (uint16_t)(t * t * (3.0f - 2.0f * t) * 256.0f + 0.5f);
+  }
+}
+
+int findName(const char* const* names, int count, const String& name) {
+  for (int i = 0; i < count; i++) {
+    if (name == names[i]) return i;
+  }
+  return -1;
+}
+
+String formatTransitions(const TransitionSetting* settings = transitionSettings) {
+  String text = "";
+  for (int i = 0; i < TRANSITION_EVENT_COUNT; i++) {
+    if (i > 0) text += ", ";
+    text += transitionEventNames[i]; text += " ";
+    text += settings[i].durationMs; text += "ms ";
+    text += transitionCurveNames[settings[i].curve];
+  }
+  return text;
+}
+
+// Parses formatTransitions() text, e.g. "beamAppear 300ms easeOut, schedule 0ms linear".
+// Events not listed keep their setting.
+bool parseTransitions(const String& text, TransitionSetting* settings) {
+  char buf[160];
+  if (text.length() >= sizeof(buf)) return false;
+  text.toCharArray(buf, sizeof(buf));
+  char* savePtr = NULL;
+  for (char* item = strtok_r(buf, ",", &savePtr); item; item = strtok_r(NULL, ",", &savePtr)) {
+    char event[16], curve[16];
+    unsigned int ms;
+    if (sscanf(item, " %15s %ums %15s", event, &ms, curve) != 3) return false;
+    int e = findName(transitionEventNames, TRANSITION_EVENT_COUNT, event);
+    int c = findName(transitionCurveNames, CURVE_COUNT, curve);
+    if (e < 0 || c < 0 || ms > TRANSITION_MAX_MS) return false;
+    settings[e].durationMs = ms;
+    settings[e].curve = c;
+  }
+  return true;
+}
+
+// Level of one layer in 1/256. start() picks up from wherever the current
+// fade is, so a reversal mid-fade never jumps.
+struct Fader {
+  uint16_t from;
+  uint16_t to;
+  unsigned long startMs;
+  TransitionSetting setting;
+
+  uint16_t level(unsigned long now) const {
+    unsigned long elapsed = now - startMs;
+    if (elapsed >= setting.durationMs) return to;
+    uint16_t eased = easingLut[setting.curve][elapsed * TRANSITION_LUT_STEPS / setting.durationMs];
+    return from + (((int32_t)to - from) * eased >> 8);
+  }
+
+  bool settled(unsigned long now) const { return now - startMs >= setting.durationMs; }
+
+  void start(uint16_t target, const TransitionSetting& how, unsigned long now) {
+    from = level(now);
+    to = target;
+    startMs = now;
+    setting = how;
+  }
+};
+
 // ------------------------- EEPROM -------------------------
-#define EEPROM_SIZE 132 // was 128, +4 bytes for int offset
+#define EEPROM_SIZE 192 // was 132, room for the appended settings
+
+// Defined further down, with idle power save and render constants
+void wakeRenderer();
+void publishRenderConstants();
+// Defined further down, with the scene presets
+extern int8_t activePreset;
+bool activePresetUnedited();
+bool restorePreset(int index);
+
+// SettingsRecord gathers every persisted setting. Boot reads it into a copy,
+// range-checks the copy and only then applies it, so the globals get either
+// valid values or the defaults. The settings store below keeps it one key
+// per field; EEPROM is only read, to move settings from older firmware: a
+// record behind a header at offset 0 (appended fields only, so a shorter
+// record's tail keeps the defaults) or the original positional layout.
+static_assert(sizeof(SettingsHeader) + sizeof(SettingsRecord) <= EEPROM_SIZE, "Settings record does not fit EEPROM_SIZE");
+
+void captureSettings(SettingsRecord& r) {
+  memset((void*)&r, 0, sizeof(r)); // Zero padding too, it is covered by the CRC
+  r.updateInterval = updateInterval;
+  r.ledOffDelay = ledOffDelay;
+  r.movingIntensity = movingIntensity;
+  r.stationaryIntensity = stationaryIntensity;
+  r.movingLength = movingLength;
+  r.centerShift = centerShift;
+  r.additionalLEDs = additionalLEDs;
+  r.baseColor = baseColor;
+  r.startHour = startHour; r.startMinute = startMinute;
+  r.endHour = endHour; r.endMinute = endMinute;
+  r.gradientSoftness = gradientSoftness;
+  r.timezoneOffsetMinutes = clientTimezoneOffsetMinutes;
+  r.timezoneSet = isTimeOffsetSet;
+  r.outputSegmentCount = outputSegmentCount;
+  memcpy(r.outputSegments, outputSegments, sizeof(r.outputSegments));
+  r.pixelRunCount = pixelRunCount;
+  memcpy(r.pixelRuns, pixelRuns, sizeof(r.pixelRuns));
+  memcpy(r.transitions, transitionSettings, sizeof(r.transitions));
+  r.powerBudgetMa = powerBudgetMa;
+  r.effectIndex = effectIndex;
+  r.maxBeams = maxBeams;
+  r.lookAheadMs = lookAheadMs;
+  r.colorGammaTenths = colorGammaTenths;
+  r.colorKelvin = colorKelvin;
+  r.whitePoint = whitePoint;
+}
 
-// Load settings from EEPROM
-void loadSettings() {
-  Serial.println("Loading settings from EEPROM...");
-  EEPROM.begin(EEPROM_SIZE);
+void applySettings(const SettingsRecord& r) {
+  updateInterval = r.updateInterval;
+  ledOffDelay = r.ledOffDelay;
+  movingIntensity = r.movingIntensity;
+  stationaryIntensity = r.stationaryIntensity;
+  movingLength = r.movingLength;
+  centerShift = r.centerShift;
+  additionalLEDs = r.additionalLEDs;
+  baseColor = r.baseColor;
+  startHour = r.startHour; startMinute = r.startMinute;
+  endHour = r.endHour; endMinute = r.endMinute;
+  gradientSoftness = r.gradientSoftness;
+  clientTimezoneOffsetMinutes = r.timezoneOffsetMinutes;
+  isTimeOffsetSet = r.timezoneSet;
+  outputSegmentCount = r.outputSegmentCount;
+  memcpy(outputSegments, r.outputSegments, sizeof(outputSegments));
+  pixelRunCount = r.pixelRunCount;
+  memcpy(pixelRuns, r.pixelRuns, sizeof(pixelRuns));
+  memcpy(transitionSettings, r.transitions, sizeof(transitionSettings));
+  powerBudgetMa = r.powerBudgetMa;
+  effectIndex = r.effectIndex;
+  maxBeams = r.maxBeams;
+  lookAheadMs = r.lookAheadMs;
+  colorGammaTenths = r.colorGammaTenths;
+  colorKelvin = r.colorKelvin;
+  whitePoint = r.whitePoint;
+}
+
+// The positional layout of the released firmware, before the settings
+// header existed: 59 bytes, with a dead speedMultiplier float. Nothing was
+// ever stored after them, so every later field keeps its default. Read once
+// on the first boot of this firmware.
+#define LEGACY_SETTINGS_BYTES 59
+
+void readLegacySettings(SettingsRecord& r) {
   int offset = 0;
+  EEPROM.get(offset, r.updateInterval); offset += sizeof(int);
+  EEPROM.get(offset, r.ledOffDelay); offset += sizeof(int);
+  EEPROM.get(offset, r.movingIntensity); offset += sizeof(float);
+  EEPROM.get(offset, r.stationaryIntensity); offset += sizeof(float);
+  EEPROM.get(offset, r.movingLength); offset += sizeof(int);
+  EEPROM.get(offset, r.centerShift); offset += sizeof(int);
+  EEPROM.get(offset, r.additionalLEDs); offset += sizeof(int);
+  EEPROM.get(offset, r.baseColor); offset += sizeof(CRGB);
+  offset += sizeof(float); // speedMultiplier, no longer used
+  EEPROM.get(offset, r.startHour); offset += sizeof(int);
+  EEPROM.get(offset, r.startMinute); offset += sizeof(int);
+  EEPROM.get(offset, r.endHour); offset += sizeof(int);
+  EEPROM.get(offset, r.endMinute); offset += sizeof(int);
+  EEPROM.get(offset, r.gradientSoftness); offset += sizeof(int);
+  EEPROM.get(offset, r.timezoneOffsetMinutes); offset += sizeof(int);
+  r.timezoneSet = (r.timezoneOffsetMinutes >= -720 && r.timezoneOffsetMinutes <= 840);
+}
 
-  EEPROM.get(offset, reinterpret_cast<int&>(updateInterval)); offset += sizeof(updateInterval);
-  EEPROM.get(offset, reinterpret_cast<int&>(ledOffDelay)); offset += sizeof(ledOffDelay);
-  EEPROM.get(offset, reinterpret_cast<float&>(movingIntensity)); offset += sizeof(movingIntensity);
-  EEPROM.get(offset, reinterpret_cast<float&>(stationaryIntensity)); offset += sizeof(stationaryIntensity);
-  EEPROM.get(offset, reinterpret_cast<int&>(movingLength)); offset += sizeof(movingLength);
-  EEPROM.get(offset, reinterpret_cast<int&>(centerShift)); offset += sizeof(centerShift);
-  {
-    int temp = additionalLEDs;
-    EEPROM.get(offset, temp);
-    additionalLEDs = temp;
-    offset += sizeof(temp);
-  }
-  EEPROM.get(offset, baseColor); offset += sizeof(baseColor);
-  offset += sizeof(float); // Skip speedMultiplier placeholder
-  EEPROM.get(offset, startHour); offset += sizeof(startHour);
-  EEPROM.get(offset, startMinute); offset += sizeof(startMinute);
-  EEPROM.get(offset, endHour); offset += sizeof(endHour);
-  EEPROM.get(offset, endMinute); offset += sizeof(endMinute);
-  EEPROM.get(offset, gradientSoftness); offset += sizeof(gradientSoftness);
-  {
-    int temp_tz = 0;
-    EEPROM.get(offset, temp_tz);
-    if (temp_tz >= -720 && temp_tz <= 840) {
-        clientTimezoneOffsetMinutes = temp_tz;
-        isTimeOffsetSet = true;
+// Reads what EEPROM held before the NVS store (the checked record, or the
+// older positional layout) into r and says where it came from. Only used to
+// move the settings over on the first boot with the store.
+const char* readEepromSettings(SettingsRecord& r) {
+  const char* source;
+  EEPROM.begin(EEPROM_SIZE);
+  SettingsHeader header;
+  EEPROM.get(0, header);
+  if (header.magic == SETTINGS_MAGIC) {
+    uint8_t raw[EEPROM_SIZE];
+    bool fits = header.version == SETTINGS_VERSION && header.length > 0 && header.length <= EEPROM_SIZE - sizeof(header);
+    if (fits) EEPROM.readBytes(sizeof(header), raw, header.length);
+    if (!fits) {
+      source = "defaults (unknown EEPROM version or length)";
+    } else if (crc32Update(0, raw, header.length) != header.crc) {
+      source = "defaults (EEPROM CRC mismatch)";
+    } else {
+      memcpy((void*)&r, raw, min((size_t)header.length, sizeof(r)));
+      source = "moved from the EEPROM record";
+    }
+  } else {
+    // Erased flash reads 0xFF, but the NVS-backed EEPROM of Arduino-ESP32
+    // fills a new or grown area with 0x00
+    uint8_t first = EEPROM.read(0);
+    bool erased = (first == 0xFF || first == 0x00);
+    for (int i = 1; i < LEGACY_SETTINGS_BYTES && erased; i++) erased = (EEPROM.read(i) == first);
+    if (erased) {
+      source = "defaults (empty EEPROM)";
     } else {
-        clientTimezoneOffsetMinutes = 0;
-        isTimeOffsetSet = false;
+      readLegacySettings(r);
+      source = "moved from the legacy EEPROM layout";
     }
-    offset += sizeof(temp_tz);
   }
   EEPROM.end();
+  return source;
+}
+
+// ------------------------- Settings Store -------------------------
+// The record, its field keys and the load and write logic are in
+// LightTrackSettings.h. ESP-IDF NVS through Preferences: wear-levelled, and
+// every entry has its own CRC, so a torn write loses only that key's new value.
+class NvsSettingsStore : public SettingsStore {
+ public:
+  bool begin() { return prefs.begin("lighttrack", false); }
+
+  bool read(const char* key, void* value, size_t size) {
+    return prefs.getBytesLength(key) == size && prefs.getBytes(key, value, size) == size;
+  }
+
+  bool write(const char* key, const void* value, size_t size) {
+    return prefs.putBytes(key, value, size) == size;
+  }
+
+  bool remove(const char* key) {
+    return prefs.remove(key) || !prefs.isKey(key);
+  }
+
+ private:
+  Preferences prefs;
+};
+
+NvsSettingsStore nvsSettingsStore;
+SettingsStore& settingsStore = nvsSettingsStore;
+SettingsState settingsState = {};
+
+void logSettingsWrite(const SettingsWrite& w) {
+  if (settingsState.readOnly) Serial.println("Settings not saved: NVS holds a newer firmware's settings");
+  else Serial.printf("Settings saved: %d key(s), %u bytes: %s\n", w.keys, w.bytes, w.ok ? "OK" : "FAILED");
+}
+
+// Write changed settings to the store now (flash program); use saveSettings() from handlers
+void writeSettings() {
+  SettingsRecord r;
+  captureSettings(r);
+  if (settingsState.storedValid && activePresetUnedited()) {
+    // The look is an activated preset, which the runtime state brings back;
+    // the settings keep the look underneath it
+    const SettingsRecord& stored = settingsState.stored;
+    r.baseColor = stored.baseColor;
+    r.movingIntensity = stored.movingIntensity;
+    r.stationaryIntensity = stored.stationaryIntensity;
+    r.movingLength = stored.movingLength;
+    r.additionalLEDs = stored.additionalLEDs;
+    r.centerShift = stored.centerShift;
+    r.gradientSoftness = stored.gradientSoftness;
+  }
+  logSettingsWrite(writeSettingsRecord(settingsStore, settingsState, r));
+}
+
+// Load settings from the store, or from EEPROM on the first boot with it.
+// Must run before anything changes the globals, whose initial values are
+// the defaults.
+void loadSettings() {
+  SettingsRecord defaults, r;
+  captureSettings(defaults);
+  SettingsLoad load = loadSettingsRecord(settingsStore, settingsState, defaults, readEepromSettings, r);
+  applySettings(r);
+
+  Serial.printf("Settings: %s, v%d, %d field(s) reset to defaults%s\n",
+                load.source, SETTINGS_VERSION, load.repaired, load.opened ? "" : ", NVS unavailable");
+  if (load.written) logSettingsWrite(load.write);
+}
+
+// Settings are written behind: saveSettings() only marks them dirty, and
+// loop() writes them once nothing has changed for SETTINGS_QUIET_MS, so a
+// dragged slider costs one flash write rather than one per step. OTA start
+// flushes straight away, before the update can reboot the device.
+#define SETTINGS_QUIET_MS 3000
+
+bool settingsDirty = false;
+unsigned long settingsChangedMs = 0;
+portMUX_TYPE settingsMux = portMUX_INITIALIZER_UNLOCKED;
+SemaphoreHandle_t settingsWriteLock = NULL;
 
-  // Validate loaded values
-  if (updateInterval < 10 || updateInterval > 200) updateInterval = 20;
-  if (ledOffDelay < 1 || ledOffDelay > 60) ledOffDelay = 5;
-  if (movingIntensity < 0.0 || movingIntensity > 1.0) movingIntensity = 0.3;
-  if (stationaryIntensity < 0.0 || stationaryIntensity > 0.1) stationaryIntensity = 0.03; // Max 10%
-  if (movingLength < 1 || movingLength > NUM_LEDS) movingLength = 33;
-  if (abs(centerShift) > NUM_LEDS/2) centerShift = 0;
-  if (additionalLEDs < 0 || additionalLEDs > NUM_LEDS/2) additionalLEDs = 0;
-  gradientSoftness = constrain(gradientSoftness, 0, 10);
-  startHour = constrain(startHour, 0, 23); startMinute = constrain(startMinute, 0, 59);
-  endHour = constrain(endHour, 0, 23); endMinute = constrain(endMinute, 0, 59);
-
-  Serial.println("Settings loaded and validated:");
-  Serial.print("Update interval: "); Serial.println(updateInterval);
-  Serial.print("LED off delay: "); Serial.println(ledOffDelay);
-  Serial.print("Moving intensity: "); Serial.print(movingIntensity * 100.0, 0); Serial.println("%");
-  Serial.print("Stationary intensity: "); Serial.print(stationaryIntensity * 100.0, 1); Serial.println("%");
-  Serial.print("Moving length: "); Serial.println(movingLength);
-  Serial.print("Center shift: "); Serial.println(centerShift);
-  Serial.print("Additional LEDs: "); Serial.println(additionalLEDs);
-  Serial.print("Gradient Softness: "); Serial.println(gradientSoftness);
-  Serial.print("Base color RGB: "); Serial.print(baseColor.r); Serial.print(", ");
-  Serial.print(baseColor.g); Serial.print(", "); Serial.println(baseColor.b);
-  Serial.printf("Schedule: %02d:%02d - %02d:%02d (Local Time)\n", startHour, startMinute, endHour, endMinute);
-  Serial.print("Client Timezone Offset: "); Serial.print(clientTimezoneOffsetMinutes); Serial.print(" minutes from UTC");
-  if (!isTimeOffsetSet) Serial.print(" (Default/Not Set)");
-  Serial.println();
-}
-
-// Save settings to EEPROM
 void saveSettings() {
-  Serial.println("Saving settings to EEPROM...");
-  EEPROM.begin(EEPROM_SIZE);
-  int offset = 0;
+  portENTER_CRITICAL(&settingsMux);
+  settingsDirty = true;
+  settingsChangedMs = millis();
+  settingsState.stats.saves++;
+  portEXIT_CRITICAL(&settingsMux);
+}
 
-  EEPROM.put(offset, updateInterval); offset += sizeof(updateInterval);
-  EEPROM.put(offset, ledOffDelay); offset += sizeof(ledOffDelay);
-  EEPROM.put(offset, movingIntensity); offset += sizeof(movingIntensity);
-  EEPROM.put(offset, stationaryIntensity); offset += sizeof(stationaryIntensity);
-  EEPROM.put(offset, movingLength); offset += sizeof(movingLength);
-  EEPROM.put(offset, centerShift); offset += sizeof(centerShift);
-  {
-    int temp = additionalLEDs;
-    EEPROM.put(offset, temp); offset += sizeof(temp);
-  }
-  EEPROM.put(offset, baseColor); offset += sizeof(baseColor);
-  offset += sizeof(float); // Skip speedMultiplier placeholder
-  EEPROM.put(offset, startHour); offset += sizeof(startHour);
-  EEPROM.put(offset, startMinute); offset += sizeof(startMinute);
-  EEPROM.put(offset, endHour); offset += sizeof(endHour);
-  EEPROM.put(offset, endMinute); offset += sizeof(endMinute);
-  EEPROM.put(offset, gradientSoftness); offset += sizeof(gradientSoftness);
-  {
-    int temp_tz = clientTimezoneOffsetMinutes;
-    EEPROM.put(offset, temp_tz);
-    offset += sizeof(temp_tz);
-  }
-
-  boolean result = EEPROM.commit();
-  EEPROM.end();
+// Writes pending settings now. Changes made during the write mark them dirty again.
+void flushSettings() {
+  xSemaphoreTake(settingsWriteLock, portMAX_DELAY);
+  portENTER_CRITICAL(&settingsMux);
+  bool dirty = settingsDirty;
+  settingsDirty = false;
+  if (dirty) settingsState.stats.flushes++;
+  portEXIT_CRITICAL(&settingsMux);
+  if (dirty) writeSettings();
+  xSemaphoreGive(settingsWriteLock);
+}
+
+void flushSettingsIfQuiet() {
+  portENTER_CRITICAL(&settingsMux);
+  bool due = settingsDirty && millis() - settingsChangedMs >= SETTINGS_QUIET_MS;
+  portEXIT_CRITICAL(&settingsMux);
+  if (due) flushSettings();
+}
+
+// ------------------------- Runtime State -------------------------
+// lightOn, the smart home override, background mode and the activated scene
+// preset change at runtime and are not settings, so a brownout used to bring the strip back in the default
+// state until the schedule could be checked again (never, in AP mode with no
+// browser to supply the time). They are kept in a ring of RUNTIME_STATE_SLOTS
+// small records in the settings store: each change writes the slot after the
+// newest one with the next sequence number and a CRC, so writes spread over
+// the slots and a write torn by power loss still leaves the previous slot.
+// setup() restores the newest valid slot before the LED task starts.
+#define RUNTIME_STATE_SLOTS 4
+
+struct RuntimeState {
+  uint32_t seq;
+  bool lightOn;
+  bool smarthomeOverride;
+  bool backgroundModeActive;
+  int8_t activePreset; // -1 for none
+  uint32_t crc; // CRC32 of the fields above
+};
+
+struct RuntimeStateStats {
+  bool restored;         // Boot found a valid slot
+  uint32_t seq;          // Sequence number of the newest slot
+  uint32_t writes;       // Slots written since boot
+  uint32_t firstFrameAppUs; // From app start to the first frame shown, 0 until then
+};
+RuntimeStateStats runtimeStats = { false, 0, 0, 0 };
+RuntimeState storedRuntimeState; // Newest slot, or the boot state if there is none
+
+uint32_t runtimeStateCrc(const RuntimeState& s) {
+  return crc32Update(0, (const uint8_t*)&s, offsetof(RuntimeState, crc));
+}
+
+void captureRuntimeState(RuntimeState& s) {
+  memset((void*)&s, 0, sizeof(s)); // Zero padding too, it is covered by the CRC
+  s.lightOn = lightOn;
+  s.smarthomeOverride = smarthomeOverride;
+  s.backgroundModeActive = backgroundModeActive;
+  s.activePreset = activePreset;
+}
+
+// Call after loadSettings(), which opens the store, and loadPresets(), and
+// before publishRenderConstants()
+void loadRuntimeState() {
+  RuntimeState newest;
+  bool found = false;
+  for (int i = 0; i < RUNTIME_STATE_SLOTS; i++) {
+    char key[8];
+    snprintf(key, sizeof(key), "state%d", i);
+    RuntimeState s;
+    if (!settingsStore.read(key, &s, sizeof(s)) || s.crc != runtimeStateCrc(s) || s.seq % RUNTIME_STATE_SLOTS != (uint32_t)i) continue;
+    if (!found || s.seq > newest.seq) {
+      newest = s;
+      found = true;
+    }
+  }
+  if (found) {
+    lightOn = newest.lightOn;
+    smarthomeOverride = newest.smarthomeOverride;
+    backgroundModeActive = newest.backgroundModeActive;
+    restorePreset(newest.activePreset); // Its slot may have been emptied since
+    storedRuntimeState = newest;
+    runtimeStats.restored = true;
+    runtimeStats.seq = newest.seq;
+  } else {
+    captureRuntimeState(storedRuntimeState); // seq 0; the first change writes seq 1
+  }
+  Serial.printf("Runtime state: %s (light %s, override %s, background %s, preset %d)\n", found ? "restored" : "defaults",
+                lightOn ? "ON" : "OFF", smarthomeOverride ? "YES" : "NO", backgroundModeActive ? "ON" : "OFF", activePreset);
+}
+
+// Writes the state to the next slot if it changed. Polled from loop(), so
+// neither the handlers nor the schedule need to call anything.
+void saveRuntimeStateIfChanged() {
+  RuntimeState s;
+  captureRuntimeState(s);
+  if (s.lightOn == storedRuntimeState.lightOn && s.smarthomeOverride == storedRuntimeState.smarthomeOverride &&
+      s.backgroundModeActive == storedRuntimeState.backgroundModeActive && s.activePreset == storedRuntimeState.activePreset) return;
+  s.seq = storedRuntimeState.seq + 1;
+  s.crc = runtimeStateCrc(s);
+  char key[8];
+  snprintf(key, sizeof(key), "state%u", (unsigned)(s.seq % RUNTIME_STATE_SLOTS));
+  xSemaphoreTake(settingsWriteLock, portMAX_DELAY);
+  bool ok = settingsStore.write(key, &s, sizeof(s));
+  xSemaphoreGive(settingsWriteLock);
+  storedRuntimeState = s; // Also on failure, so a broken store is not retried on every pass
+  runtimeStats.seq = s.seq;
+  runtimeStats.writes++;
+  if (!ok) Serial.println("Runtime state write FAILED");
+}
+
+// ------------------------- Boot Profiling -------------------------
+// setup() stamps the end of each boot phase with micros(). That clock starts
+// with the app, so the ROM and second-stage bootloader (and any deep-sleep
+// wake stub) come before zero and are not included. The LED task starts as soon as the settings are loaded, so "render"
+// is where the strip takes over; the first frame lands shortly after (see
+// runtimeStats.firstFrameAppUs) while Wi-Fi, NTP and OTA are still coming up.
+// Reported once on serial and at /boot.
+#define MAX_BOOT_PHASES 12
+
+struct BootPhase {
+  const char* name;
+  uint32_t us; // Since app start
+};
+BootPhase bootPhases[MAX_BOOT_PHASES];
+uint8_t bootPhaseCount = 0;
+
+void markBootPhase(const char* name) {
+  if (bootPhaseCount >= MAX_BOOT_PHASES) return;
+  bootPhases[bootPhaseCount].name = name;
+  bootPhases[bootPhaseCount].us = micros();
+  bootPhaseCount++;
+}
 
-  Serial.print("Settings saved to EEPROM: ");
-  Serial.println(result ? "OK" : "FAILED");
+void logBootPhases() {
+  Serial.print("Boot (ms since app start):");
+  for (int i = 0; i < bootPhaseCount; i++) {
+    Serial.printf(" %s %.1f", bootPhases[i].name, bootPhases[i].us / 1000.0);
+  }
+  Serial.printf(", first frame %.1f\n", runtimeStats.firstFrameAppUs / 1000.0);
 }
 
 // ------------------------- Web Server -------------------------
@@ -184,6 +666,33 @@ void handleSmartHomeOff();
 void handleSmartHomeClear();
 void handleToggleBackgroundMode();
 void handleGetCurrentTime(); // NEW: Handler for getting current time
+void handleGetStatus();
+void handleGetBoot();
+void handleSetSegments();
+void handleSetPixelMap();
+void handleSetTransition();
+void handleSetPowerBudget();
+void handleSetEffect();
+void handleSetMaxBeams();
+void handleSetLookAhead();
+void handleSetGamma();
+void handleSetKelvin();
+void handleSetWhitePoint();
+void handleSavePreset();
+void handleActivatePreset();
+void handleDeletePreset();
+void handleExportSettings();
+void handleImportSettings();
+void handleImportUpload();
+#ifdef RENDER_PROFILING
+void handleGetProfile();
+#endif
+#ifdef RENDER_SNAPSHOTS
+void handleGetSnapshots();
+#endif
+#ifdef RENDER_BENCHMARK
+void handleGetBenchmark();
+#endif
 void updateTime();
 
 // OTA setup prototype
@@ -193,11 +702,13 @@ void setupOTA();
 void handleSmartHomeOn() {
   lightOn = true;
   smarthomeOverride = true;
+  wakeRenderer();
   server.send(200, "text/plain", "Smart Home Override: ON");
 }
 void handleSmartHomeOff() {
   lightOn = false;
   smarthomeOverride = true;
+  wakeRenderer();
   server.send(200, "text/plain", "Smart Home Override: OFF");
 }
 
@@ -230,6 +741,7 @@ void handleSmartHomeClear() {
     Serial.println(lightOn ? "ON" : "OFF");
     Serial.printf(" (Based on Est. Local Time: %02d:%02d)\n", timeinfo_local.tm_hour, timeinfo_local.tm_min);
   }
+  wakeRenderer();
   server.send(200, "text/plain", "Smart Home Override: CLEARED");
 }
 
@@ -237,12 +749,30 @@ void handleSmartHomeClear() {
 // ------------------------- Mode Handlers -------------------------
 void handleToggleBackgroundMode() {
   backgroundModeActive = !backgroundModeActive;
+  publishRenderConstants();
   Serial.print("Background mode toggled: "); Serial.println(backgroundModeActive ? "ON" : "OFF");
   server.sendHeader("Location", "/");
   server.send(303);
 }
 
 // ------------------------- Sensor Reading Function -------------------------
+#define SENSOR_BAUD 256000
+
+// UART1 counts its baud rate from the 40 MHz crystal instead of APB, which
+// dynamic frequency scaling drops to 40 MHz with the CPU, so the rate holds
+// at every CPU frequency
+void beginSensorUart() {
+  Serial1.begin(SENSOR_BAUD, SERIAL_8N1, SENSOR_RX_PIN, SENSOR_TX_PIN);
+  uart_config_t config = {};
+  config.baud_rate = SENSOR_BAUD;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  config.source_clk = UART_SCLK_XTAL;
+  uart_param_config(UART_NUM_1, &config);
+}
+
 unsigned int readSensorData() {
 #ifndef SIMULATE_SENSOR
   if (Serial1.available() < 7) return g_sensorDistance;
@@ -271,149 +801,842 @@ unsigned int readSensorData() {
 #endif
 }
 
+struct SensorTargets {
+  uint8_t count;
+  unsigned int distances[MAX_TARGETS];
+};
+
+// Fills targets with the people the sensor currently reports. The radar
+// reports a single target; the simulation adds a second walker going the
+// other way so multi-beam rendering can be exercised.
+void readSensorTargets(SensorTargets& targets) {
+  targets.distances[0] = readSensorData();
+  targets.count = 1;
+#ifdef SIMULATE_SENSOR
+  targets.distances[1] = MIN_DISTANCE + MAX_DISTANCE - targets.distances[0];
+  targets.count = 2;
+#endif
+}
+
+// ------------------------- Idle Power Save -------------------------
+// Once a frame is black and no fade is running, ledTask stops rendering and
+// blocks on a task notification. The sensor task wakes it on movement; the
+// control paths (settings, schedule, smart home, background toggle, OTA)
+// wake it through wakeRenderer(). It also rechecks once a second, so a
+// missed wake costs at most that. ESP-IDF dynamic frequency scaling and
+// automatic light sleep are enabled at boot; ledTask holds a CPU_FREQ_MAX
+// lock only while it renders. Only idle time and entries are reported: the
+// energy saved depends on the board and is not measured here.
+//
+// The 40 MHz floor and sleep are safe for both peripherals that run while
+// ledTask idles. UART1 is clocked from the crystal (beginSensorUart()), and
+// sensorTask holds a NO_LIGHT_SLEEP lock for as long as it reads the sensor,
+// since light sleep would stop the UART and lose the bytes that should wake
+// the renderer. Since the sensor is always read, the saving in practice is
+// the frequency drop, not sleep. RMT symbol timing assumes the 80 MHz APB, so
+// the idle path waits for the last frame to leave the wire before it
+// releases the render lock (FastLED.show() has already waited).
+#define IDLE_RECHECK_MS      1000
+#define CPU_MAX_MHZ          160
+#define CPU_MIN_MHZ          40
+
+TaskHandle_t ledTaskHandle = NULL;
+volatile bool rendererIdle = false;
+esp_pm_lock_handle_t renderPmLock = NULL;
+esp_pm_lock_handle_t sensorPmLock = NULL;
+bool powerManagementOn = false;
+
+struct IdleStats {
+  uint64_t idleMs;        // Total time blocked in idle
+  uint32_t entries;       // Times ledTask went idle
+  unsigned long sinceMs;  // Start of the current idle period
+};
+IdleStats idleStats = { 0, 0, 0 };
+portMUX_TYPE idleMux = portMUX_INITIALIZER_UNLOCKED;
+
+void wakeRenderer() {
+  if (ledTaskHandle != NULL) xTaskNotifyGive(ledTaskHandle);
+}
+
+// Defined further down, with the LED output
+void waitForLedOutput();
+
+void setupPowerManagement() {
+  esp_pm_config_esp32c3_t pm;
+  pm.max_freq_mhz = CPU_MAX_MHZ;
+  pm.min_freq_mhz = CPU_MIN_MHZ;
+  pm.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&pm);
+  powerManagementOn = (err == ESP_OK && esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "render", &renderPmLock) == ESP_OK);
+  if (powerManagementOn) esp_pm_lock_acquire(renderPmLock); // Rendering from the start
+  Serial.print("Power management (DFS + light sleep): ");
+  Serial.println(powerManagementOn ? "ON" : esp_err_to_name(err));
+}
+
+// Idle time including the running period, for reports
+uint64_t totalIdleMs() {
+  portENTER_CRITICAL(&idleMux);
+  uint64_t ms = idleStats.idleMs + (rendererIdle ? millis() - idleStats.sinceMs : 0);
+  portEXIT_CRITICAL(&idleMux);
+  return ms;
+}
+
+// Called by ledTask after showing a black, settled frame. Returns on a wake
+// notification or after IDLE_RECHECK_MS.
+void idleUntilWoken() {
+  portENTER_CRITICAL(&idleMux);
+  rendererIdle = true;
+  idleStats.entries++;
+  idleStats.sinceMs = millis();
+  portEXIT_CRITICAL(&idleMux);
+  waitForLedOutput();
+  if (powerManagementOn) esp_pm_lock_release(renderPmLock);
+
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_RECHECK_MS));
+
+  if (powerManagementOn) esp_pm_lock_acquire(renderPmLock);
+  portENTER_CRITICAL(&idleMux);
+  idleStats.idleMs += millis() - idleStats.sinceMs;
+  rendererIdle = false;
+  portEXIT_CRITICAL(&idleMux);
+}
+
+// ------------------------- Color Pipeline -------------------------
+// Picked colours go through a per-channel table that decodes the gamma
+// (when set above 1.0) and applies the white balance: colour temperature,
+// the install's white point and the strip correction, all per-channel gains,
+// i.e. a diagonal correction matrix folded into the tables. Output is linear
+// LED duty in 8.8 fixed point. The tables are rebuilt only when those settings
+// change, and converting a colour is then three lookups with no float.
+uint16_t colorLut[3][256];
+
+// Relative RGB of a black body at kelvin (Tanner Helland's fit), scaled so the
+// largest channel is 1 and 6500 K comes out neutral
+void kelvinToGains(uint16_t kelvin, float gains[3]) {
+  const float neutral[3] = { 255.0f, 254.1f, 250.0f }; // The fit at 6500 K
+  float t = kelvin / 100.0f;
+  float rgb[3];
+  rgb[0] = (t <= 66) ? 255.0f : 329.698727446f * powf(t - 60, -0.1332047592f);
+  rgb[1] = (t <= 66) ? 99.4708025861f * logf(t) - 161.1195681661f : 288.1221695283f * powf(t - 60, -0.0755148492f);
+  rgb[2] = (t >= 66) ? 255.0f : (t <= 19) ? 0.0f : 138.5177312231f * logf(t - 10) - 305.0447927307f;
+  float largest = 0;
+  for (int c = 0; c < 3; c++) {
+    gains[c] = constrain(rgb[c], 0.0f, 255.0f) / neutral[c];
+    largest = max(largest, gains[c]);
+  }
+  for (int c = 0; c < 3; c++) gains[c] /= largest;
+}
+
+void buildColorLut() {
+  // Settings the table was last built for
+  static uint8_t builtGamma = 0;
+  static uint16_t builtKelvin = 0;
+  static CRGB builtWhitePoint;
+  if (colorGammaTenths == builtGamma && colorKelvin == builtKelvin && memcmp(&whitePoint, &builtWhitePoint, sizeof(CRGB)) == 0) return;
+  builtGamma = colorGammaTenths;
+  builtKelvin = colorKelvin;
+  builtWhitePoint = whitePoint;
+
+  float gains[3];
+  kelvinToGains(colorKelvin, gains);
+  float gamma = colorGammaTenths / 10.0f;
+  for (int c = 0; c < 3; c++) {
+    float gain = gains[c] * (whitePoint.raw[c] / 255.0f) * (ledColorCorrection[c] / 255.0f);
+    for (int v = 0; v < 256; v++) {
+      colorLut[c][v] = (uint16_t)(powf(v / 255.0f, gamma) * gain * 255.0f * 256.0f + 0.5f);
+    }
+  }
+}
+
+// ------------------------- Render Constants -------------------------
+// Everything the frame loop derives from settings is computed here once per
+// settings change and handed to ledTask through a triple buffer, so the hot
+// loop only reads precomputed values and never sees a half-built set. This is
+// the only way settings reach ledTask: it takes one snapshot per frame and
+// reads no setting globals, so a handler changing several settings can never
+// produce a frame that mixes old and new values. Handlers that change a
+// setting the frame uses must call publishRenderConstants(). RenderConstants
+// itself, and the beam shape built into it, are in LightTrackRender.h.
+
+// Lock-free single-writer/single-reader mailbox. The writer fills back() and
+// publishes it; the reader picks up the newest published slot in read().
+// Each side owns its slot exclusively, so neither ever blocks or tears.
+template <typename T>
+class TripleBuffer {
+ public:
+  T& back() { return slots[backIndex]; }
+
+  void publish() {
+    backIndex = middle.exchange(backIndex | FRESH) & ~FRESH;
+  }
+
+  const T& read() {
+    if (middle.load() & FRESH) frontIndex = middle.exchange(frontIndex) & ~FRESH;
+    return slots[frontIndex];
+  }
+
+ private:
+  static const uint8_t FRESH = 0x80;
+  T slots[3];
+  std::atomic<uint8_t> middle{1};
+  uint8_t backIndex = 0;
+  uint8_t frontIndex = 2;
+};
+
+TripleBuffer<RenderConstants> renderConstants;
+RenderConstants publishedRenderConstants; // Writer-side copy of the last publish
+SemaphoreHandle_t renderConstantsWriteLock = NULL;
+
+// Rebuilds the constants from the current settings and hands them to ledTask.
+// Cheap no-op if nothing the renderer uses has changed.
+void publishRenderConstants() {
+  if (renderConstantsWriteLock == NULL) renderConstantsWriteLock = xSemaphoreCreateMutex(); // First call is from setup()
+  xSemaphoreTake(renderConstantsWriteLock, portMAX_DELAY);
+
+  RenderConstants& k = renderConstants.back();
+  memset((void*)&k, 0, sizeof(k)); // Zero padding too, the change check compares raw bytes
+  // Both are linear LED duty, which is the space the eye averages the
+  // dithered frames in, so the mean output keeps the hue.
+  buildColorLut();
+  for (int c = 0; c < 3; c++) {
+    uint16_t linear = colorLut[c][baseColor.raw[c]];
+    k.background16[c] = (uint16_t)(linear * stationaryIntensity + 0.5f);
+    k.beamColor.raw[c] = (uint8_t)((uint16_t)(linear * movingIntensity) >> 8);
+  }
+  computeBeamShape(k, movingLength, additionalLEDs, gradientSoftness, centerShift);
+  memcpy(k.transitions, transitionSettings, sizeof(k.transitions));
+  k.effect = effectIndex;
+  k.maxBeams = maxBeams;
+  k.lookAheadMs = lookAheadMs;
+  k.background = backgroundModeActive;
+  k.ledOffDelayMs = ledOffDelay * 1000UL;
+  k.updateInterval = updateInterval;
+  k.powerBudgetMa = powerBudgetMa;
+
+  if (memcmp(&k, &publishedRenderConstants, sizeof(k)) != 0) {
+    memcpy((void*)&publishedRenderConstants, &k, sizeof(k));
+    renderConstants.publish();
+    wakeRenderer();
+  }
+  xSemaphoreGive(renderConstantsWriteLock);
+}
+
+// ------------------------- Scene Presets -------------------------
+// A preset is a named copy of the look of the strip: colour, intensities,
+// beam shape and background mode. Activating one sets those settings and
+// publishes them in one go, so the next frame switches over completely, with
+// no flash write: only the preset's index is kept, in the runtime state, and
+// boot applies the preset again. The settings keep the look from before
+// until one of its settings is edited, which ends the preset. Saving a preset
+// writes only that preset's key; deleting one removes it.
+#define MAX_PRESETS     4
+#define PRESET_NAME_LEN 16
+
+struct ScenePreset {
+  char name[PRESET_NAME_LEN]; // Empty marks a free slot
+  CRGB baseColor;
+  float movingIntensity;
+  float stationaryIntensity;
+  int16_t movingLength;
+  int16_t additionalLEDs;
+  int16_t centerShift;
+  uint8_t gradientSoftness;
+  bool background;
+};
+ScenePreset presets[MAX_PRESETS];
+int8_t activePreset = -1; // Last preset activated, -1 for none
+
+// 1..15 characters that need no escaping in the page, JSON or a URL path
+bool isValidPresetName(const String& name) {
+  if (name.length() < 1 || name.length() >= PRESET_NAME_LEN) return false;
+  for (unsigned i = 0; i < name.length(); i++) {
+    char c = name[i];
+    if (c < 0x20 || c > 0x7E || c == '"' || c == '\'' || c == '\\' || c == '<' || c == '>' || c == '&') return false;
+  }
+  return true;
+}
+
+bool isValidPreset(const ScenePreset& p) {
+  if (p.name[0] == 0 || memchr(p.name, 0, PRESET_NAME_LEN) == NULL) return false;
+  return p.movingIntensity >= 0.0f && p.movingIntensity <= 1.0f &&
+         p.stationaryIntensity >= 0.0f && p.stationaryIntensity <= 0.1f &&
+         p.movingLength >= 1 && p.movingLength <= NUM_LEDS &&
+         p.additionalLEDs >= 0 && p.additionalLEDs <= NUM_LEDS / 2 &&
+         abs(p.centerShift) <= NUM_LEDS / 2 && p.gradientSoftness <= 10;
+}
+
+int findPreset(const String& name) {
+  for (int i = 0; i < MAX_PRESETS; i++) {
+    if (presets[i].name[0] != 0 && name == presets[i].name) return i;
+  }
+  return -1;
+}
+
+// Sets the look settings from presets[index], leaving background mode and publishing to the caller
+void applyPresetLook(int index) {
+  const ScenePreset& p = presets[index];
+  baseColor = p.baseColor;
+  movingIntensity = p.movingIntensity;
+  stationaryIntensity = p.stationaryIntensity;
+  movingLength = p.movingLength;
+  additionalLEDs = p.additionalLEDs;
+  centerShift = p.centerShift;
+  gradientSoftness = p.gradientSoftness;
+  activePreset = index;
+}
+
+void activatePreset(int index) {
+  applyPresetLook(index);
+  backgroundModeActive = presets[index].background;
+  publishRenderConstants(); // One publish, so ledTask sees all of it from the same frame
+}
+
+// Boot: the preset that was active, over the loaded settings. Background mode
+// comes from the runtime state itself, since it may have been toggled since.
+bool restorePreset(int index) {
+  if (index < 0 || index >= MAX_PRESETS || presets[index].name[0] == 0) return false;
+  applyPresetLook(index);
+  return true;
+}
+
+// True while the look settings still hold the active preset. Once any of
+// them has been edited the preset has ended: activePreset is cleared, and the
+// edited look is saved as the settings' own.
+bool activePresetUnedited() {
+  if (activePreset < 0) return false;
+  const ScenePreset& p = presets[activePreset];
+  if (baseColor == p.baseColor && movingIntensity == p.movingIntensity &&
+      stationaryIntensity == p.stationaryIntensity && movingLength == p.movingLength &&
+      additionalLEDs == p.additionalLEDs && centerShift == p.centerShift && gradientSoftness == p.gradientSoftness) {
+    return true;
+  }
+  activePreset = -1;
+  return false;
+}
+
+// Stores presets[index] as it is now; a free slot (empty name) removes the key
+void storePreset(int index) {
+  char key[8];
+  snprintf(key, sizeof(key), "preset%d", index);
+  xSemaphoreTake(settingsWriteLock, portMAX_DELAY);
+  bool ok = (presets[index].name[0] == 0) ? settingsStore.remove(key)
+                                          : settingsStore.write(key, &presets[index], sizeof(ScenePreset));
+  xSemaphoreGive(settingsWriteLock);
+  Serial.printf("Preset %d stored: %s\n", index, ok ? "OK" : "FAILED");
+}
+
+// Captures the current look into the preset called name, reusing its slot or taking a free one
+int savePreset(const String& name) {
+  int index = findPreset(name);
+  for (int i = 0; i < MAX_PRESETS && index < 0; i++) {
+    if (presets[i].name[0] == 0) index = i;
+  }
+  if (index < 0) return -1;
+  ScenePreset& p = presets[index];
+  memset((void*)&p, 0, sizeof(p));
+  name.toCharArray(p.name, sizeof(p.name));
+  p.baseColor = baseColor;
+  p.movingIntensity = movingIntensity;
+  p.stationaryIntensity = stationaryIntensity;
+  p.movingLength = movingLength;
+  p.additionalLEDs = additionalLEDs;
+  p.centerShift = centerShift;
+  p.gradientSoftness = gradientSoftness;
+  p.background = backgroundModeActive;
+  storePreset(index);
+  return index;
+}
+
+void loadPresets() {
+  int loaded = 0;
+  for (int i = 0; i < MAX_PRESETS; i++) {
+    char key[8];
+    snprintf(key, sizeof(key), "preset%d", i);
+    if (!settingsStore.read(key, &presets[i], sizeof(ScenePreset)) || !isValidPreset(presets[i])) {
+      memset((void*)&presets[i], 0, sizeof(ScenePreset));
+    } else {
+      loaded++;
+    }
+  }
+  Serial.printf("Presets: %d of %d slots used\n", loaded, MAX_PRESETS);
+}
+
+// ------------------------- Target Tracking -------------------------
+// sensorTask publishes every sample's targets; ledTask matches them to
+// tracks by nearest distance within TRACK_GATE_CM. Each track does the
+// movement detection the single beam used to do and has its own direction,
+// ledOffDelay timeout and fade. A target with no track nearby takes a free
+// slot; with none free the nearest track follows it, so maxBeams = 1 gives
+// the old single beam. With lookAheadMs set, each track also keeps a smoothed
+// speed and stretches its beam head by the distance it will cover.
+struct Track {
+  bool active;
+  bool moving;                     // Within ledOffDelay of the last movement
+  int8_t direction;                // +1 away from the sensor, 0 before the first movement
+  unsigned int distance;
+  unsigned long lastMovementTime;
+  unsigned long lastSeenMs;
+  Fader fader;                     // Beam appear/timeout fade
+  int32_t velocityQ4;              // Smoothed cm/s in 1/16, + away from the sensor
+  unsigned int velocityRefDistance;
+  unsigned long velocityRefMs;
+  uint16_t extensionQ8;            // Look-ahead LEDs ahead of the head, 1/256, slew limited
+};
+
+TripleBuffer<SensorTargets> sensorTargets; // sensorTask -> ledTask
+Track tracks[MAX_TARGETS];                 // Owned by ledTask
+
+void moveTrack(Track& track, unsigned int distance, unsigned long now) {
+  int diff = (int)distance - (int)track.distance;
+  if (abs(diff) >= NOISE_THRESHOLD) {
+    if (now - track.lastMovementTime > 50 || (diff > 0 && track.direction < 0) || (diff < 0 && track.direction > 0)) {
+      track.lastMovementTime = now;
+      track.direction = (diff > 0) ? 1 : -1;
+    }
+  }
+  track.distance = distance;
+
+  // Speed over the last window, smoothed with a 1/4 exponential average
+  unsigned long windowMs = now - track.velocityRefMs;
+  if (windowMs >= VELOCITY_WINDOW_MS) {
+    int32_t instantQ4 = ((int32_t)distance - (int32_t)track.velocityRefDistance) * 16000 / (int32_t)windowMs;
+    track.velocityQ4 += (instantQ4 - track.velocityQ4) / 4;
+    track.velocityRefDistance = distance;
+    track.velocityRefMs = now;
+  }
+}
+
+// Look-ahead target in 1/256 LED: the distance covered in lookAheadMs at the
+// smoothed speed, converted to LEDs and capped at LOOKAHEAD_MAX_LEDS
+uint32_t lookAheadTargetQ8(const Track& track, const RenderConstants& k, int ledCount) {
+  if (k.lookAheadMs == 0) return 0;
+  int32_t speed = abs(track.velocityQ4) / 16 - VELOCITY_DEADBAND;
+  if (speed <= 0) return 0;
+  speed = min(speed, (int32_t)(MAX_DISTANCE - MIN_DISTANCE)); // Bounds the product below
+  uint32_t travelCm = (uint32_t)speed * k.lookAheadMs / 1000;
+  uint32_t ledsQ8 = travelCm * (uint32_t)(ledCount - 1) * 256 / (MAX_DISTANCE - MIN_DISTANCE);
+  return min(ledsQ8, (uint32_t)LOOKAHEAD_MAX_LEDS * 256);
+}
+
+void updateTracks(const SensorTargets& targets, const RenderConstants& k, unsigned long now) {
+  bool matched[MAX_TARGETS] = {};
+  for (int t = 0; t < targets.count; t++) {
+    unsigned int distance = targets.distances[t];
+    int nearest = -1, freeSlot = -1;
+    int nearestGap = MAX_DISTANCE + 1;
+    for (int i = 0; i < k.maxBeams; i++) {
+      if (!tracks[i].active) {
+        if (freeSlot < 0) freeSlot = i;
+      } else if (!matched[i] && abs((int)distance - (int)tracks[i].distance) < nearestGap) {
+        nearest = i;
+        nearestGap = abs((int)distance - (int)tracks[i].distance);
+      }
+    }
+    if ((nearest < 0 || nearestGap > TRACK_GATE_CM) && freeSlot >= 0) {
+      Track& track = tracks[freeSlot];
+      memset((void*)&track, 0, sizeof(track));
+      track.active = true;
+      track.distance = distance;
+      track.velocityRefDistance = distance;
+      track.velocityRefMs = now;
+      track.lastMovementTime = now; // Someone new counts as movement
+      matched[freeSlot] = true;
+    } else if (nearest >= 0) {
+      moveTrack(tracks[nearest], distance, now);
+      matched[nearest] = true;
+    }
+  }
+
+  for (int i = 0; i < MAX_TARGETS; i++) {
+    Track& track = tracks[i];
+    if (!track.active) continue;
+    if (i >= k.maxBeams) {
+      // Left over after maxBeams was lowered: no longer matched, it fades out
+      // like a beam timeout rather than vanishing mid-frame
+      if (track.moving) {
+        track.fader.start(0, k.transitions[TRANSITION_BEAM_TIMEOUT], now);
+        track.moving = false;
+      }
+      if (track.fader.level(now) == 0) track.active = false;
+      continue;
+    }
+    if (matched[i]) track.lastSeenMs = now;
+
+    bool moving = (now - track.lastMovementTime <= k.ledOffDelayMs);
+    if (moving != track.moving) {
+      track.fader.start(moving ? 256 : 0, k.transitions[moving ? TRANSITION_BEAM_APPEAR : TRANSITION_BEAM_TIMEOUT], now);
+      track.moving = moving;
+    }
+    if (now - track.lastSeenMs > TRACK_LOST_MS && track.fader.level(now) == 0) track.active = false;
+
+    uint32_t target = lookAheadTargetQ8(track, k, logicalLedCount);
+    if (target > track.extensionQ8) track.extensionQ8 = min(target, (uint32_t)track.extensionQ8 + LOOKAHEAD_GROW_Q8);
+    else track.extensionQ8 = max(target, (uint32_t)max((int)track.extensionQ8 - LOOKAHEAD_SHRINK_Q8, 0));
+  }
+}
+
+// ------------------------- LED Output -------------------------
+// Default path is FastLED.show(), which blocks for the whole transmit.
+// Build with -DLED_OUTPUT_RMT to pre-encode the frame into RMT symbols and
+// return as soon as it is queued; completion is signalled from the RMT ISR.
+// The RMT path drives every output segment on its own channel in parallel.
+#define LED_WIRE_US_PER_LED   30  // 24 bits * 1.25 us per bit
+#define LED_LATCH_US          50  // A gap this long mid-frame latches the strip
+
+uint8_t outputBrightness = 255; // Power limiter scale for the next showLeds(), 255 = unscaled
+
+struct LedOutputStats {
+  uint32_t frames;          // Frames fully transmitted
+  uint32_t lastTransmitUs;  // Duration of the last transmit
+  uint32_t maxTransmitUs;
+  uint64_t totalTransmitUs;
+  uint32_t glitches;        // Transmits stretched by more than LED_LATCH_US
+  uint32_t overruns;        // Frames ready before the previous one finished (RMT only)
+};
+LedOutputStats ledOutputStats;
+portMUX_TYPE ledOutputMux = portMUX_INITIALIZER_UNLOCKED;
+volatile uint32_t ledExpectedWireUs = (uint32_t)NUM_LEDS * LED_WIRE_US_PER_LED; // Longest segment on the wire
+volatile bool outputLayoutChanged = false; // Set by /setSegments, applied by the LED task
+
+void IRAM_ATTR recordLedTransmit(uint32_t transmitUs) {
+  portENTER_CRITICAL_SAFE(&ledOutputMux);
+  ledOutputStats.frames++;
+  ledOutputStats.lastTransmitUs = transmitUs;
+  ledOutputStats.totalTransmitUs += transmitUs;
+  if (transmitUs > ledOutputStats.maxTransmitUs) ledOutputStats.maxTransmitUs = transmitUs;
+  if (transmitUs > ledExpectedWireUs + LED_LATCH_US) ledOutputStats.glitches++;
+  portEXIT_CRITICAL_SAFE(&ledOutputMux);
+}
+
+#ifdef LED_OUTPUT_RMT
+#define RMT_CLK_DIV     2 // 80 MHz APB / 2 = 25 ns per tick
+// WS2812B bit timings in RMT ticks (T0H 400 ns / T0L 850 ns, T1H 800 ns / T1L 450 ns)
+#define RMT_T0H 16
+#define RMT_T0L 34
+#define RMT_T1H 32
+#define RMT_T1L 18
+
+
+// Reused every frame, never reallocated. Segment i encodes into the slice
+// starting at its first LED, so non-overlapping segments never share symbols.
+rmt_item32_t rmtSymbols[NUM_LEDS * 24];
+rmt_item32_t rmtBit0, rmtBit1;
+OutputSegment rmtSegments[MAX_OUTPUT_SEGMENTS]; // Layout the channels are set up for
+uint8_t rmtSegmentCount = 0;
+SemaphoreHandle_t rmtTxDone = NULL;
+volatile uint8_t rmtPendingChannels = 0;
+volatile uint32_t rmtTxStartUs = 0;
+
+void IRAM_ATTR onRmtTxEnd(rmt_channel_t channel, void * arg) {
+  if (--rmtPendingChannels > 0) return; // Wait for the longest segment
+  recordLedTransmit(micros() - rmtTxStartUs);
+  BaseType_t higherPriorityWoken = pdFALSE;
+  xSemaphoreGiveFromISR(rmtTxDone, &higherPriorityWoken);
+  if (higherPriorityWoken) portYIELD_FROM_ISR();
+}
+
+inline rmt_item32_t* encodeRmtByte(rmt_item32_t* out, uint8_t value) {
+  for (uint8_t mask = 0x80; mask; mask >>= 1) {
+    *out++ = (value & mask) ? rmtBit1 : rmtBit0;
+  }
+  return out;
+}
+
+// (Re)binds one RMT channel per segment. Only called while no transmit is running.
+void applyRmtLayout() {
+  for (int i = 0; i < rmtSegmentCount; i++) {
+    rmt_driver_uninstall((rmt_channel_t)i);
+    gpio_reset_pin((gpio_num_t)rmtSegments[i].pin);
+  }
+
+  portENTER_CRITICAL(&ledOutputMux);
+  memcpy(rmtSegments, outputSegments, sizeof(rmtSegments));
+  rmtSegmentCount = outputSegmentCount;
+  outputLayoutChanged = false;
+  portEXIT_CRITICAL(&ledOutputMux);
+
+  uint16_t longest = 0;
+  for (int i = 0; i < rmtSegmentCount; i++) {
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)rmtSegments[i].pin, (rmt_channel_t)i);
+    config.clk_div = RMT_CLK_DIV;
+    rmt_config(&config);
+    rmt_driver_install((rmt_channel_t)i, 0, 0);
+    longest = max(longest, rmtSegments[i].count);
+  }
+  ledExpectedWireUs = (uint32_t)longest * LED_WIRE_US_PER_LED;
+  Serial.print("RMT output layout: "); Serial.println(formatSegmentLayout());
+}
+
+void setupLedOutput() {
+  rmtBit0.level0 = 1; rmtBit0.duration0 = RMT_T0H; rmtBit0.level1 = 0; rmtBit0.duration1 = RMT_T0L;
+  rmtBit1.level0 = 1; rmtBit1.duration0 = RMT_T1H; rmtBit1.level1 = 0; rmtBit1.duration1 = RMT_T1L;
+
+  applyRmtLayout();
+  rmt_register_tx_end_callback(onRmtTxEnd, NULL);
+
+  rmtTxDone = xSemaphoreCreateBinary();
+  xSemaphoreGive(rmtTxDone); // Buffer starts out free
+}
+
+// Encodes leds[] (GRB order, colour corrected) and starts all segments.
+// Only blocks if the previous frame is still on the wire.
+void showLeds() {
+  if (xSemaphoreTake(rmtTxDone, 0) != pdTRUE) {
+    portENTER_CRITICAL(&ledOutputMux);
+    ledOutputStats.overruns++;
+    portEXIT_CRITICAL(&ledOutputMux);
+    xSemaphoreTake(rmtTxDone, portMAX_DELAY);
+  }
+  if (outputLayoutChanged) applyRmtLayout();
+
+  for (int s = 0; s < rmtSegmentCount; s++) {
+    const OutputSegment& seg = rmtSegments[s];
+    rmt_item32_t* out = rmtSymbols + seg.start * 24;
+    for (int i = seg.start; i < seg.start + seg.count; i++) {
+      out = encodeRmtByte(out, scale8(leds[i].g, outputBrightness)); // scale8(x, 255) == x
+      out = encodeRmtByte(out, scale8(leds[i].r, outputBrightness));
+      out = encodeRmtByte(out, scale8(leds[i].b, outputBrightness));
+    }
+  }
+
+  rmtPendingChannels = rmtSegmentCount;
+  rmtTxStartUs = micros();
+  for (int s = 0; s < rmtSegmentCount; s++) {
+    rmt_write_items((rmt_channel_t)s, rmtSymbols + rmtSegments[s].start * 24, rmtSegments[s].count * 24, false);
+  }
+}
+
+// Blocks until the frame on the wire has finished
+void waitForLedOutput() {
+  xSemaphoreTake(rmtTxDone, portMAX_DELAY);
+  xSemaphoreGive(rmtTxDone);
+}
+#else
+void setupLedOutput() {
+  FastLED.addLeds<CHIPSET, LED_PIN, COLOR_ORDER>(leds, NUM_LEDS).setCorrection(UncorrectedColor); // Corrected at render time
+  FastLED.setBrightness(255);
+}
+
+void showLeds() {
+  uint32_t startUs = micros();
+  FastLED.show(outputBrightness);
+  recordLedTransmit(micros() - startUs);
+}
+
+void waitForLedOutput() {} // FastLED.show() returns once the frame is out
+#endif
+
+const char* ledOutputDriverName() {
+#ifdef LED_OUTPUT_RMT
+  return "rmt";
+#else
+  return "fastled";
+#endif
+}
+
+// ------------------------- Power Budget -------------------------
+// The frame's current is estimated without walking the strip: the background
+// is uniform on average, so it costs logicalLedCount times one pixel, and the
+// beam loop adds the difference for just the pixels it overwrites. If the
+// estimate exceeds the budget, the output is scaled down for that frame.
+// The per-pixel figure, pixelLoad(), is in LightTrackRender.h.
+struct PowerStats {
+  uint32_t requestedMa;   // Estimate before limiting
+  uint32_t drawnMa;       // Estimate after limiting
+  uint8_t  brightness;    // Scale applied, 255 = none
+  uint32_t limitedFrames;
+  uint64_t chargeMaMs;    // Cumulative, for energy
+};
+PowerStats powerStats = { 0, 0, 255, 0, 0 };
+portMUX_TYPE powerMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Takes the frame's pixel load (mA/255 units) and the time since the last
+// frame; returns the brightness that keeps the strip within the budget.
+uint8_t applyPowerBudget(int32_t load, uint32_t frameMs, uint16_t budgetMa) {
+  const uint32_t idleMa = NUM_LEDS * LED_MA_IDLE; // Dark and unmapped LEDs still draw this
+  uint32_t pixelMa = max(load, (int32_t)0) / 255;
+  uint32_t requestedMa = idleMa + pixelMa;
+
+  uint8_t brightness = 255;
+  if (budgetMa > 0 && requestedMa > budgetMa) {
+    brightness = (budgetMa > idleMa) ? (budgetMa - idleMa) * 255 / pixelMa : 0;
+  }
+  uint32_t drawnMa = idleMa + pixelMa * brightness / 255;
+
+  portENTER_CRITICAL(&powerMux);
+  powerStats.requestedMa = requestedMa;
+  powerStats.drawnMa = drawnMa;
+  powerStats.brightness = brightness;
+  if (brightness < 255) powerStats.limitedFrames++;
+  powerStats.chargeMaMs += (uint64_t)drawnMa * frameMs;
+  portEXIT_CRITICAL(&powerMux);
+  return brightness;
+}
+
+// ------------------------- Render Profiling -------------------------
+// Build with -DRENDER_PROFILING to time each ledTask stage with the CPU cycle
+// counter. The stages and the PROFILE_BEGIN/PROFILE_END macros are in
+// LightTrackRender.h; without the flag they expand to nothing.
+#ifdef RENDER_PROFILING
+#define PROFILE_WINDOW       128 // Rolling window per stage (frames)
+#define PROFILE_HIST_BUCKETS 16  // Bucket n holds samples of [2^(n-1), 2^n) us
+
+const char* const renderStageNames[STAGE_COUNT] = {
+  "readSample", "movement", "background", "layers", "effect", "map", "show", "frame"
+};
+
+struct StageProfile {
+  uint32_t window[PROFILE_WINDOW];          // Last samples in CPU cycles
+  uint16_t head;                            // Next write slot in window
+  uint16_t filled;                          // Valid samples in window
+  uint32_t histogram[PROFILE_HIST_BUCKETS]; // Cumulative, in microseconds
+};
+StageProfile stageProfiles[STAGE_COUNT];
+portMUX_TYPE profileMux = portMUX_INITIALIZER_UNLOCKED;
+
+void recordStageCycles(RenderStage stage, uint32_t cycles) {
+  uint32_t us = cycles / ESP.getCpuFreqMHz();
+  uint8_t bucket = 0;
+  while (us > 0 && bucket < PROFILE_HIST_BUCKETS - 1) { us >>= 1; bucket++; }
+
+  StageProfile& p = stageProfiles[stage];
+  portENTER_CRITICAL(&profileMux);
+  p.window[p.head] = cycles;
+  p.head = (p.head + 1) % PROFILE_WINDOW;
+  if (p.filled < PROFILE_WINDOW) p.filled++;
+  p.histogram[bucket]++;
+  portEXIT_CRITICAL(&profileMux);
+}
+#endif
+
+// ------------------------- Effects -------------------------
+// The effects, the compositor and effectRegistry[] are in LightTrackRender.h.
+int findEffect(const String& name) {
+  for (int i = 0; i < EFFECT_COUNT; i++) {
+    if (name == effectRegistry[i]->name()) return i;
+  }
+  return -1;
+}
+
 // ------------------------- RTOS Tasks -------------------------
 void sensorTask(void * parameter) {
   Serial.println("Sensor Task started");
+  if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "sensor", &sensorPmLock) == ESP_OK) {
+    esp_pm_lock_acquire(sensorPmLock); // Held for good: UART1 must keep receiving
+  }
+  SensorTargets lastWake = {};
   for (;;) {
-    unsigned int newDistance = readSensorData();
-    g_sensorDistance = newDistance;
+    SensorTargets& targets = sensorTargets.back();
+    readSensorTargets(targets);
+    g_sensorDistance = targets.distances[0];
+
+    // Movement (or someone new) wakes an idle renderer
+    bool moved = (targets.count != lastWake.count);
+    for (int t = 0; t < targets.count && !moved; t++) {
+      moved = abs((int)targets.distances[t] - (int)lastWake.distances[t]) >= NOISE_THRESHOLD;
+    }
+    if (moved) {
+      lastWake = targets;
+      wakeRenderer(); // Unconditional: rendererIdle may not be set yet when ledTask is about to block
+    }
+    sensorTargets.publish();
     vTaskDelay(pdMS_TO_TICKS(5));
   }
 }
 
 void ledTask(void * parameter) {
-  static unsigned int lastSensor = g_sensorDistance;
-  static int lastMovementDirection = 0;
-  static unsigned long lastMovementTime = millis();
-
-  FastLED.clear();
-  FastLED.show();
-  vTaskDelay(pdMS_TO_TICKS(1000)); // Initial delay
+  // Layers start dark with no edge seen yet, so the first frame fades everything in;
+  // a state restored after a power loss is shown at once instead
+  bool lastLightOn = runtimeStats.restored && lightOn;
+  bool lastBackgroundActive = runtimeStats.restored && backgroundModeActive;
+  Fader scheduleFader = { 0, (uint16_t)(lastLightOn ? 256 : 0), 0, { 0, CURVE_LINEAR } };
+  Fader backgroundFader = { 0, (uint16_t)(lastBackgroundActive ? 256 : 0), 0, { 0, CURVE_LINEAR } };
+  uint8_t ditherFrame = 0;
+  unsigned long lastFrameMillis = millis();
 
   Serial.println("LED Task initialized and starting main loop");
 
   for (;;) {
+    if (pixelMapChanged) rebuildPixelMap();
+
+    PROFILE_BEGIN(STAGE_FRAME);
+    PROFILE_BEGIN(STAGE_READ_SAMPLE);
     unsigned long currentMillis = millis();
-    unsigned int currentDistance = g_sensorDistance;
-    int diff = (int)currentDistance - (int)lastSensor;
-    int absDiff = abs(diff);
-
-    // Movement detection
-    if (absDiff >= NOISE_THRESHOLD) {
-        if (currentMillis - lastMovementTime > 50 || (diff > 0 && lastMovementDirection < 0) || (diff < 0 && lastMovementDirection > 0)) {
-           lastMovementTime = currentMillis;
-           lastMovementDirection = (diff > 0) ? 1 : -1;
-        }
-    }
-    lastSensor = currentDistance;
+    const SensorTargets& targets = sensorTargets.read();
+    PROFILE_END(STAGE_READ_SAMPLE);
 
-    bool drawMovingPart = (currentMillis - lastMovementTime <= ledOffDelay * 1000);
+    PROFILE_BEGIN(STAGE_MOVEMENT);
+    const RenderConstants& k = renderConstants.read(); // Stable for the whole frame
 
-    // --- Background Fill ---
-    if (!lightOn) {
-        fill_solid(leds, NUM_LEDS, CRGB::Black);
-    } else if (backgroundModeActive) {
-        // Use stationaryIntensity (0.0 to 0.1)
-        uint8_t r = max((uint8_t)1, (uint8_t)(baseColor.r * stationaryIntensity));
-        uint8_t g = max((uint8_t)1, (uint8_t)(baseColor.g * stationaryIntensity));
-        uint8_t b = max((uint8_t)1, (uint8_t)(baseColor.b * stationaryIntensity));
-        fill_solid(leds, NUM_LEDS, CRGB(r, g, b));
-    } else {
-        fill_solid(leds, NUM_LEDS, CRGB::Black);
-    }
-
-    // --- Moving Beam Drawing ---
-    if (lightOn && drawMovingPart) {
-        float prop = constrain((float)(currentDistance - MIN_DISTANCE) / (MAX_DISTANCE - MIN_DISTANCE), 0.0, 1.0);
-        int ledPosition = round(prop * (NUM_LEDS - 1));
-        int centerLED = constrain(ledPosition + centerShift, 0, NUM_LEDS - 1);
-
-        // Use movingIntensity (0.0 to 1.0)
-        CRGB fullBrightColor = CRGB((uint8_t)(baseColor.r * movingIntensity),
-                                   (uint8_t)(baseColor.g * movingIntensity),
-                                   (uint8_t)(baseColor.b * movingIntensity));
-
-        int direction = lastMovementDirection;
-        if (direction == 0) direction = 1; // Default direction if no movement detected yet
-
-        int halfMainLength = movingLength / 2;
-        int totalLightLength = movingLength + additionalLEDs;
-        if (totalLightLength <= 0) totalLightLength = 1;
-
-        int leftEdge, rightEdge;
-        if (direction > 0) { // Moving away
-            leftEdge = centerLED - halfMainLength;
-            rightEdge = leftEdge + movingLength - 1 + additionalLEDs;
-        } else { // Moving towards
-            rightEdge = centerLED + halfMainLength;
-            leftEdge = rightEdge - movingLength + 1 - additionalLEDs;
-        }
+    // Movement detection, per tracked person
+    updateTracks(targets, k, currentMillis);
 
-        // Clamp edges to valid LED indices
-        leftEdge = max(0, leftEdge);
-        rightEdge = min(NUM_LEDS - 1, rightEdge);
-
-        // Calculate effective gradient parameters using gradientSoftness
-        int effectiveFadeWidth = map(gradientSoftness, 0, 10, 1, 10);
-        float effectiveFadeExponent = 1.0 + (gradientSoftness / 10.0) * 2.0;
-
-        int actualBeamPixelLength = rightEdge - leftEdge + 1;
-        effectiveFadeWidth = constrain(effectiveFadeWidth, 1, max(1, actualBeamPixelLength / 2));
-
-        // Draw the beam with gradient
-        for (int i = leftEdge; i <= rightEdge; i++) {
-            int posInBeam;
-            if (direction > 0) {
-                posInBeam = i - leftEdge;
-            } else {
-                posInBeam = rightEdge - i;
-            }
-
-            float factor = 1.0f;
-
-            // Apply fade if needed
-            if (gradientSoftness > 0 && totalLightLength > 1) {
-                if (posInBeam < effectiveFadeWidth) {
-                    float normalizedPos = (effectiveFadeWidth > 0) ? (float)(posInBeam + 1) / (effectiveFadeWidth + 1) : 1.0f;
-                    factor = pow(normalizedPos, effectiveFadeExponent);
-                }
-                else if (posInBeam >= (totalLightLength - effectiveFadeWidth)) {
-                    int posFromEnd = totalLightLength - 1 - posInBeam;
-                    float normalizedPos = (effectiveFadeWidth > 0) ? (float)(posFromEnd + 1) / (effectiveFadeWidth + 1) : 1.0f;
-                    factor = pow(normalizedPos, effectiveFadeExponent);
-                }
-            }
-
-            factor = constrain(factor, 0.0f, 1.0f);
-
-            // Set LED color if factor is significant
-            if (factor > 0.01f) {
-                CRGB beamColor;
-                beamColor.r = (uint8_t)(fullBrightColor.r * factor);
-                beamColor.g = (uint8_t)(fullBrightColor.g * factor);
-                beamColor.b = (uint8_t)(fullBrightColor.b * factor);
-
-                // Blend with background if background mode is active
-                if (backgroundModeActive) {
-                    uint8_t bgR = max((uint8_t)1, (uint8_t)(baseColor.r * stationaryIntensity));
-                    uint8_t bgG = max((uint8_t)1, (uint8_t)(baseColor.g * stationaryIntensity));
-                    uint8_t bgB = max((uint8_t)1, (uint8_t)(baseColor.b * stationaryIntensity));
-
-                    leds[i].r = max(beamColor.r, leds[i].r);
-                    leds[i].g = max(beamColor.g, leds[i].g);
-                    leds[i].b = max(beamColor.b, leds[i].b);
-                    leds[i].r = max(leds[i].r, bgR);
-                    leds[i].g = max(leds[i].g, bgG);
-                    leds[i].b = max(leds[i].b, bgB);
-                } else {
-                    leds[i] = beamColor; // Just set the beam color
-                }
-            }
-        } // End of pixel loop
-    } // End of drawMovingPart
-
-    FastLED.show();
-    vTaskDelay(pdMS_TO_TICKS(updateInterval));
+    // Start a fade on every on/off edge, then reduce each layer to one level for this frame
+    bool lightOnNow = lightOn, backgroundActive = k.background;
+    if (lightOnNow != lastLightOn) {
+        scheduleFader.start(lightOnNow ? 256 : 0, k.transitions[TRANSITION_SCHEDULE], currentMillis);
+        lastLightOn = lightOnNow;
+    }
+    if (backgroundActive != lastBackgroundActive) {
+        backgroundFader.start(backgroundActive ? 256 : 0, k.transitions[TRANSITION_BACKGROUND], currentMillis);
+        lastBackgroundActive = backgroundActive;
+    }
+    PROFILE_END(STAGE_MOVEMENT);
+
+    FrameContext frame;
+    frame.k = &k;
+    frame.pixels = logicalLeds;
+    frame.count = logicalLedCount;
+    frame.masterLevel = scheduleFader.level(currentMillis);
+    frame.beamCount = 0;
+    for (int i = 0; i < MAX_TARGETS; i++) {
+        if (!tracks[i].active) continue;
+        uint16_t level = (frame.masterLevel * tracks[i].fader.level(currentMillis)) >> 8;
+        if (level == 0) continue;
+        BeamTarget& beam = frame.beams[frame.beamCount++];
+        beam.distance = tracks[i].distance;
+        beam.direction = (tracks[i].direction != 0) ? tracks[i].direction : 1; // Default direction if no movement detected yet
+        beam.level = level;
+        beam.extension = tracks[i].extensionQ8 >> 8;
+    }
+    frame.backgroundLevel = (frame.masterLevel * backgroundFader.level(currentMillis)) >> 8;
+    frame.frame = ditherFrame++;
+    frame.load = 0;
+
+    PROFILE_BEGIN(STAGE_EFFECT);
+    renderFrame(frame);
+    PROFILE_END(STAGE_EFFECT);
+
+    // --- Logical to physical mapping ---
+    PROFILE_BEGIN(STAGE_MAP);
+    for (int i = 0; i < logicalLedCount; i++) {
+        if (pixelMap[i] != PIXEL_GAP) leds[pixelMap[i]] = logicalLeds[i];
+    }
+    PROFILE_END(STAGE_MAP);
+
+    outputBrightness = applyPowerBudget(frame.load, currentMillis - lastFrameMillis, k.powerBudgetMa);
+    lastFrameMillis = currentMillis;
+
+    PROFILE_BEGIN(STAGE_SHOW);
+    showLeds();
+    PROFILE_END(STAGE_SHOW);
+    PROFILE_END(STAGE_FRAME);
+    if (runtimeStats.firstFrameAppUs == 0) {
+      runtimeStats.firstFrameAppUs = micros(); // Counts from app start, bootloader time not included
+      Serial.printf("First frame %lu ms after app start\n", (unsigned long)(runtimeStats.firstFrameAppUs / 1000));
+    }
+
+    // A black frame with every fade settled stays black until something wakes us
+    bool settled = (frame.load == 0) && scheduleFader.settled(currentMillis) && backgroundFader.settled(currentMillis);
+    for (int i = 0; i < MAX_TARGETS && settled; i++) {
+        settled = !tracks[i].active || tracks[i].fader.settled(currentMillis);
+    }
+    if (settled) {
+        idleUntilWoken();
+        lastFrameMillis = millis(); // Idle time is not a frame for the energy total
+    } else {
+        vTaskDelay(pdMS_TO_TICKS(k.updateInterval));
+    }
   } // End of infinite loop
 }
 
@@ -422,7 +1645,7 @@ void webServerTask(void * parameter) {
   for (;;) {
     server.handleClient();
     ArduinoOTA.handle(); // Handle OTA updates here
-    vTaskDelay(pdMS_TO_TICKS(2)); // Small delay for web server handling
+    vTaskDelay(pdMS_TO_TICKS(rendererIdle ? 20 : 2)); // Small delay for web server handling; longer while idle so the CPU can clock down
   }
 }
 
@@ -499,9 +1722,10 @@ void updateTime() {
 
     // Check that time is synchronized and offset is set
     if (nowUtc < 1000000000UL || !isTimeOffsetSet) {
-        // Default ON if time/TZ not set, but only if not overridden
-        if (!smarthomeOverride) {
+        // Default ON if time/TZ not set, but only if not overridden and not restored after a power loss
+        if (!smarthomeOverride && !lightOn && !runtimeStats.restored) {
             lightOn = true;
+            wakeRenderer();
         }
         return; // Exit if we cannot check schedule
     }
@@ -526,6 +1750,7 @@ void updateTime() {
     // Update light state if schedule changes it AND no manual override
     if (!smarthomeOverride && (lightOn != shouldBeOn)) {
         lightOn = shouldBeOn;
+        wakeRenderer();
         Serial.print("Schedule updated light state to: "); Serial.println(lightOn ? "ON" : "OFF");
         Serial.printf(" (Based on Est. Local Time: %02d:%02d)\n", timeinfo_local.tm_hour, timeinfo_local.tm_min);
     }
@@ -556,6 +1781,252 @@ void handleGetCurrentTime() {
   server.send(200, "application/json", json);
 }
 
+// Runtime status as JSON (LED output driver timing and glitch counters)
+void handleGetStatus() {
+  LedOutputStats out;
+  portENTER_CRITICAL(&ledOutputMux);
+  out = ledOutputStats;
+  portEXIT_CRITICAL(&ledOutputMux);
+
+  String json = "{\"uptime\":";
+  json += millis() / 1000;
+  json += ",\"output\":{\"driver\":\""; json += ledOutputDriverName();
+  json += "\",\"frames\":"; json += out.frames;
+  json += ",\"wireUs\":"; json += ledExpectedWireUs;
+  json += ",\"lastUs\":"; json += out.lastTransmitUs;
+  json += ",\"avgUs\":"; json += (uint32_t)(out.frames ? out.totalTransmitUs / out.frames : 0);
+  json += ",\"maxUs\":"; json += out.maxTransmitUs;
+  json += ",\"glitches\":"; json += out.glitches;
+  json += ",\"overruns\":"; json += out.overruns;
+#ifdef LED_OUTPUT_RMT
+  json += ",\"segments\":\""; json += formatSegmentLayout(); json += "\"";
+#endif
+  PowerStats power;
+  portENTER_CRITICAL(&powerMux);
+  power = powerStats;
+  portEXIT_CRITICAL(&powerMux);
+  json += "},\"power\":{\"budgetMa\":"; json += powerBudgetMa;
+  json += ",\"requestedMa\":"; json += power.requestedMa;
+  json += ",\"mA\":"; json += power.drawnMa;
+  json += ",\"watts\":"; json += String(power.drawnMa * LED_SUPPLY_VOLTS / 1000.0, 2);
+  json += ",\"wh\":"; json += String(power.chargeMaMs * LED_SUPPLY_VOLTS / 3.6e9, 4);
+  json += ",\"brightness\":"; json += power.brightness;
+  json += ",\"limitedFrames\":"; json += power.limitedFrames;
+  json += "},\"idle\":{\"active\":"; json += rendererIdle ? "true" : "false";
+  json += ",\"ms\":"; json += String((double)totalIdleMs(), 0);
+  json += ",\"entries\":"; json += idleStats.entries;
+  json += ",\"pm\":"; json += powerManagementOn ? "true" : "false";
+  json += "},\"settings\":{\"pending\":"; json += settingsDirty ? "true" : "false";
+  json += ",\"changes\":"; json += settingsState.stats.saves;
+  json += ",\"flushes\":"; json += settingsState.stats.flushes;
+  json += ",\"keyWrites\":"; json += settingsState.stats.keyWrites;
+  json += ",\"bytes\":"; json += settingsState.stats.bytes;
+  json += "},\"runtime\":{\"restored\":"; json += runtimeStats.restored ? "true" : "false";
+  json += ",\"seq\":"; json += runtimeStats.seq;
+  json += ",\"writes\":"; json += runtimeStats.writes;
+  json += ",\"firstFrameAppMs\":"; json += String(runtimeStats.firstFrameAppUs / 1000.0, 1);
+  json += "},\"presets\":{\"active\":\""; if (activePreset >= 0) json += presets[activePreset].name;
+  json += "\",\"names\":[";
+  bool firstPreset = true;
+  for (int i = 0; i < MAX_PRESETS; i++) {
+    if (presets[i].name[0] == 0) continue;
+    if (!firstPreset) json += ",";
+    json += "\""; json += presets[i].name; json += "\"";
+    firstPreset = false;
+  }
+  json += "]}}";
+  server.send(200, "application/json", json);
+}
+
+// Boot phases in ms since app start (bootloader excluded), e.g.
+// {"phases":{"serial":0.3,...,"ready":640.2},"firstFrameAppMs":48.7,"restored":true}
+void handleGetBoot() {
+  String json = "{\"phases\":{";
+  for (int i = 0; i < bootPhaseCount; i++) {
+    if (i > 0) json += ",";
+    json += "\""; json += bootPhases[i].name; json += "\":"; json += String(bootPhases[i].us / 1000.0, 1);
+  }
+  json += "},\"firstFrameAppMs\":"; json += String(runtimeStats.firstFrameAppUs / 1000.0, 1);
+  json += ",\"restored\":"; json += runtimeStats.restored ? "true" : "false";
+  json += "}";
+  server.send(200, "application/json", json);
+}
+
+#ifdef RENDER_PROFILING
+// Returns rolling min/avg/p99/max per ledTask stage (microseconds) plus the
+// cumulative log2 histogram. Pass ?reset=1 to clear all stats afterwards.
+void handleGetProfile() {
+  uint32_t cpuMHz = ESP.getCpuFreqMHz();
+  String json = "{\"cpuMHz\":";
+  json += cpuMHz;
+  json += ",\"updateInterval\":";
+  json += updateInterval;
+  json += ",\"stages\":[";
+
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    uint32_t samples[PROFILE_WINDOW];
+    uint32_t histogram[PROFILE_HIST_BUCKETS];
+    uint16_t count;
+    portENTER_CRITICAL(&profileMux);
+    count = stageProfiles[s].filled;
+    memcpy(samples, stageProfiles[s].window, count * sizeof(uint32_t));
+    memcpy(histogram, stageProfiles[s].histogram, sizeof(histogram));
+    portEXIT_CRITICAL(&profileMux);
+
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i++) sum += samples[i];
+    std::sort(samples, samples + count);
+
+    if (s > 0) json += ",";
+    json += "{\"name\":\""; json += renderStageNames[s];
+    json += "\",\"samples\":"; json += count;
+    if (count > 0) {
+      int p99Index = (count * 99 + 99) / 100 - 1;
+      json += ",\"min\":"; json += String((float)samples[0] / cpuMHz, 2);
+      json += ",\"avg\":"; json += String((float)sum / count / cpuMHz, 2);
+      json += ",\"p99\":"; json += String((float)samples[p99Index] / cpuMHz, 2);
+      json += ",\"max\":"; json += String((float)samples[count - 1] / cpuMHz, 2);
+    }
+    json += ",\"hist\":[";
+    for (int b = 0; b < PROFILE_HIST_BUCKETS; b++) {
+      if (b > 0) json += ",";
+      json += histogram[b];
+    }
+    json += "]}";
+  }
+  json += "]}";
+
+  if (server.hasArg("reset")) {
+    portENTER_CRITICAL(&profileMux);
+    memset(stageProfiles, 0, sizeof(stageProfiles));
+    portEXIT_CRITICAL(&profileMux);
+  }
+  server.send(200, "application/json", json);
+}
+#endif
+
+#if defined(RENDER_SNAPSHOTS) || defined(RENDER_BENCHMARK)
+// Timing for the shared snapshot and benchmark code: CPU cycles
+struct CycleClock {
+  static uint32_t ticks() { return ESP.getCycleCount(); }
+  static float ticksPerUs() { return ESP.getCpuFreqMHz(); }
+};
+#endif
+
+#ifdef RENDER_SNAPSHOTS
+// Frame snapshots: build with -DRENDER_SNAPSHOTS and GET /snapshots. Streams
+// the cases from LightTrackSnapshots.h as CSV, one line per case with the
+// frame's CRC32 and the average compute time, then the digest over all of
+// them. test/snapshot_test checks the same cases on the host against the
+// committed goldens; pass ?expect=<digest> to check the device against the
+// digest at the end of test/golden/snapshots.csv.
+CRGB snapshotLeds[SNAPSHOT_LEDS];
+
+void handleGetSnapshots() {
+  RenderConstants k;
+  FrameContext f;
+  beginSnapshots(k, f, snapshotLeds);
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/csv", SNAPSHOT_CSV_HEADER);
+  uint32_t digest = 0;
+  String lines;
+  for (size_t n = 0; n < SNAPSHOT_CASES; n++) {
+    SnapshotCase c = snapshotCase(n);
+    float us;
+    uint32_t crc = renderSnapshot<CycleClock>(c, k, f, us);
+    digest = crc32Update(digest, (const uint8_t*)&crc, sizeof(crc));
+    char line[96];
+    formatSnapshotLine(line, sizeof(line), c, crc, us);
+    lines += line;
+    size_t perShape = SNAPSHOT_AXIS(snapshotDirections) * SNAPSHOT_AXIS(snapshotBackgrounds) * SNAPSHOT_AXIS(snapshotDistances);
+    if ((n + 1) % perShape == 0) { // One chunk per beam shape keeps the String small
+      server.sendContent(lines);
+      lines = "";
+    }
+  }
+  server.sendContent(lines);
+
+  char line[64];
+  String expected = server.arg("expect");
+  snprintf(line, sizeof(line), "digest,%08x,%s\n", (unsigned)digest,
+           expected.length() == 0 ? "-" : (strtoul(expected.c_str(), NULL, 16) == digest ? "match" : "MISMATCH"));
+  server.sendContent(line);
+  server.sendContent("");
+  Serial.printf("Snapshots: digest %08x\n", (unsigned)digest);
+}
+#endif
+
+#ifdef RENDER_BENCHMARK
+// Render benchmark: build with -DRENDER_BENCHMARK and GET /benchmark. Runs
+// the sweep from LightTrackBenchmark.h on the device and streams its CSV;
+// test/render_benchmark runs the same sweep on the host. It holds the web
+// task for a few seconds.
+//
+// Add -DCOUNT_SOFT_FLOAT to also count the soft-float library calls each
+// pass makes (the C3 has no FPU). It wraps the libgcc helpers, so the link
+// needs the matching flags, e.g. in platform.local.txt:
+//   compiler.c.elf.extra_flags=-Wl,--wrap=__addsf3,--wrap=__subsf3,--wrap=__mulsf3,--wrap=__divsf3,--wrap=__floatsisf,--wrap=__fixsfsi,--wrap=__adddf3,--wrap=__subdf3,--wrap=__muldf3,--wrap=__divdf3,--wrap=__extendsfdf2,--wrap=__truncdfsf2
+CRGB benchmarkLeds[BENCHMARK_MAX_LEDS];
+
+#ifdef COUNT_SOFT_FLOAT
+// Only calls from the benchmark's own task are counted
+volatile uint32_t softFloatCalls = 0;
+TaskHandle_t softFloatTask = NULL;
+
+#define SOFT_FLOAT_WRAP(ret, name, params, args) \
+  extern "C" ret __real_##name params; \
+  extern "C" ret __wrap_##name params { \
+    if (xTaskGetCurrentTaskHandle() == softFloatTask) softFloatCalls++; \
+    return __real_##name args; \
+  }
+SOFT_FLOAT_WRAP(float, __addsf3, (float a, float b), (a, b))
+SOFT_FLOAT_WRAP(float, __subsf3, (float a, float b), (a, b))
+SOFT_FLOAT_WRAP(float, __mulsf3, (float a, float b), (a, b))
+SOFT_FLOAT_WRAP(float, __divsf3, (float a, float b), (a, b))
+SOFT_FLOAT_WRAP(float, __floatsisf, (int a), (a))
+SOFT_FLOAT_WRAP(int, __fixsfsi, (float a), (a))
+SOFT_FLOAT_WRAP(double, __adddf3, (double a, double b), (a, b))
+SOFT_FLOAT_WRAP(double, __subdf3, (double a, double b), (a, b))
+SOFT_FLOAT_WRAP(double, __muldf3, (double a, double b), (a, b))
+SOFT_FLOAT_WRAP(double, __divdf3, (double a, double b), (a, b))
+SOFT_FLOAT_WRAP(double, __extendsfdf2, (float a), (a))
+SOFT_FLOAT_WRAP(float, __truncdfsf2, (double a), (a))
+#define SOFT_FLOAT_COUNT() softFloatCalls
+#else
+#define SOFT_FLOAT_COUNT() 0
+#endif
+
+struct BenchmarkClock : CycleClock {
+  static uint32_t floatCalls() { return SOFT_FLOAT_COUNT(); }
+};
+
+// Sends each strip length's rows as one chunk
+struct BenchmarkHttpOut {
+  String rows;
+  void row(const char* line) { rows += line; }
+  void flush() {
+    server.sendContent(rows);
+    rows = "";
+    vTaskDelay(1); // Let the other tasks run between strip lengths
+  }
+};
+
+void handleGetBenchmark() {
+#ifdef COUNT_SOFT_FLOAT
+  softFloatTask = xTaskGetCurrentTaskHandle();
+#endif
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/csv", BENCHMARK_CSV_HEADER);
+  BenchmarkHttpOut out;
+  runRenderBenchmark<BenchmarkClock>(benchmarkLeds, out);
+  server.sendContent("");
+#ifdef COUNT_SOFT_FLOAT
+  softFloatTask = NULL;
+#endif
+  Serial.println("Benchmark done");
+}
+#endif
 
 // (handleSetSchedule, handleNotFound - no changes needed)
 void handleSetSchedule() {
@@ -582,6 +2053,74 @@ void handleNotFound() {
   server.send(404, "text/plain", "Not Found");
 }
 
+// Sets the output segment layout, e.g. /setSegments?layout=2:0:150,3:150:150
+void handleSetSegments() {
+#ifdef LED_OUTPUT_RMT
+  OutputSegment segments[MAX_OUTPUT_SEGMENTS] = {};
+  uint8_t count = 0;
+  if (!server.hasArg("layout") || !parseSegmentLayout(server.arg("layout"), segments, count)) {
+    server.send(400, "text/plain", "Invalid layout (pin:start:count,...)");
+    return;
+  }
+  portENTER_CRITICAL(&ledOutputMux);
+  memcpy(outputSegments, segments, sizeof(outputSegments));
+  outputSegmentCount = count;
+  outputLayoutChanged = true; // LED task rebinds the channels before its next frame
+  portEXIT_CRITICAL(&ledOutputMux);
+  wakeRenderer();
+  Serial.print("Output segments set to: "); Serial.println(formatSegmentLayout());
+  saveSettings();
+  server.send(200, "text/plain", "OK");
+#else
+  server.send(400, "text/plain", "Segmented output requires the LED_OUTPUT_RMT build");
+#endif
+}
+
+// Sets the logical to physical pixel map, e.g. /setPixelMap?runs=0-99,gap40,199-100
+void handleSetPixelMap() {
+  PixelRun runs[MAX_MAP_RUNS] = {};
+  uint8_t count = 0;
+  if (!server.hasArg("runs") || !parsePixelRuns(server.arg("runs"), runs, count)) {
+    server.send(400, "text/plain", "Invalid map (first-last,gapN,...)");
+    return;
+  }
+  memcpy(pixelRuns, runs, sizeof(pixelRuns));
+  pixelRunCount = count;
+  pixelMapChanged = true;
+  wakeRenderer();
+  Serial.print("Pixel map set to: "); Serial.println(formatPixelRuns());
+  saveSettings();
+  server.send(200, "text/plain", "OK");
+}
+
+// Sets one transition, e.g. /setTransition?event=beamTimeout&ms=2000&curve=easeInOut
+void handleSetTransition() {
+  int event = findName(transitionEventNames, TRANSITION_EVENT_COUNT, server.arg("event"));
+  if (event < 0) {
+    server.send(400, "text/plain", "Unknown event");
+    return;
+  }
+  // Both arguments are checked before either is applied, so a bad request
+  // leaves the transition unchanged
+  TransitionSetting setting = transitionSettings[event];
+  if (server.hasArg("ms")) {
+    long ms = server.arg("ms").toInt();
+    setting.durationMs = constrain(ms, 0L, (long)TRANSITION_MAX_MS);
+  }
+  if (server.hasArg("curve")) {
+    int curve = findName(transitionCurveNames, CURVE_COUNT, server.arg("curve"));
+    if (curve < 0) {
+      server.send(400, "text/plain", "Unknown curve");
+      return;
+    }
+    setting.curve = curve;
+  }
+  transitionSettings[event] = setting;
+  Serial.print("Transitions set to: "); Serial.println(formatTransitions());
+  publishRenderConstants();
+  saveSettings();
+  server.send(200, "text/plain", "OK");
+}
 
 // ------------------------- WiFi Setup -------------------------
 void setupWiFi() {
@@ -626,6 +2165,32 @@ void setupWiFi() {
   server.on("/smarthome/clear", handleSmartHomeClear);
   server.on("/toggleNightMode", handleToggleBackgroundMode);
   server.on("/getCurrentTime", handleGetCurrentTime); // NEW: Register time endpoint
+  server.on("/status", handleGetStatus);
+  server.on("/boot", handleGetBoot);
+  server.on("/setSegments", handleSetSegments);
+  server.on("/setPixelMap", handleSetPixelMap);
+  server.on("/setTransition", handleSetTransition);
+  server.on("/setPowerBudget", handleSetPowerBudget);
+  server.on("/setEffect", handleSetEffect);
+  server.on("/setMaxBeams", handleSetMaxBeams);
+  server.on("/setLookAhead", handleSetLookAhead);
+  server.on("/setGamma", handleSetGamma);
+  server.on("/setKelvin", handleSetKelvin);
+  server.on("/setWhitePoint", handleSetWhitePoint);
+  server.on("/savePreset", handleSavePreset);
+  server.on("/activatePreset", handleActivatePreset);
+  server.on("/deletePreset", handleDeletePreset);
+  server.on("/exportSettings", handleExportSettings);
+  server.on("/importSettings", HTTP_POST, handleImportSettings, handleImportUpload);
+#ifdef RENDER_PROFILING
+  server.on("/profile", handleGetProfile);
+#endif
+#ifdef RENDER_SNAPSHOTS
+  server.on("/snapshots", handleGetSnapshots);
+#endif
+#ifdef RENDER_BENCHMARK
+  server.on("/benchmark", handleGetBenchmark);
+#endif
   server.onNotFound(handleNotFound);
 
   server.begin();
@@ -695,6 +2260,19 @@ void handleRoot() {
   html += "function setAdditionalLEDs(val) { fetch('/setAdditionalLEDs?value=' + val); }";
   html += "function setCenterShift(val) { fetch('/setCenterShift?value=' + val); }";
   html += "function setLedOffDelay(val) { fetch('/setLedOffDelay?value=' + val); }";
+  html += "function setPowerBudget(val) { fetch('/setPowerBudget?value=' + val); }";
+  html += "function setEffect(name) { fetch('/setEffect?name=' + name); }";
+  html += "function presetAction(action, name) {"; // Reloads so the sliders show the preset
+  html += "fetch('/' + action + 'Preset?name=' + encodeURIComponent(name)).then(r => r.text()).then(t => { if (t != 'OK') alert(t); else location.reload(); }); }";
+  html += "function setMaxBeams(val) { fetch('/setMaxBeams?value=' + val); }";
+  html += "function setLookAhead(val) { fetch('/setLookAhead?value=' + val); }";
+  html += "function setGamma(val) { fetch('/setGamma?value=' + val); }";
+  html += "function setKelvin(val) { fetch('/setKelvin?value=' + val); }";
+  html += "function setWhitePoint(hex) {";
+  html += "var r = parseInt(hex.substring(1,3),16);";
+  html += "var g = parseInt(hex.substring(3,5),16);";
+  html += "var b = parseInt(hex.substring(5,7),16);";
+  html += "fetch('/setWhitePoint?r=' + r + '&g=' + g + '&b=' + b); }";
   html += "function setSchedule(startTime, endTime) {"; // Schedule change still reloads page
   html += "var sParts = startTime.split(':');";
   html += "var eParts = endTime.split(':');";
@@ -702,6 +2280,11 @@ void handleRoot() {
   html += "'&endHour=' + eParts[0] + '&endMinute=' + eParts[1]).then(()=>location.reload()); }";
   html += "function toggleBackgroundMode() { fetch('/toggleNightMode').then(()=>location.reload()); }"; // Reload needed to update button text
   html += "function setGradientSoftness(val) { fetch('/setGradientSoftness?value=' + val); }";
+  html += "function setPixelMap(runs) {";
+  html += "fetch('/setPixelMap?runs=' + encodeURIComponent(runs)).then(r => r.text()).then(t => { if (t != 'OK') alert(t); }); }";
+  html += "function setTransition(event, query) { fetch('/setTransition?event=' + event + '&' + query); }";
+  html += "function setSegments(layout) {";
+  html += "fetch('/setSegments?layout=' + encodeURIComponent(layout)).then(r => r.text()).then(t => { if (t != 'OK') alert(t); }); }";
 
   html += "// Update time every 5 seconds";
   html += "setInterval(updateTimeDisplay, 5000);";
@@ -714,6 +2297,22 @@ void handleRoot() {
   html += "<div class='container'>";
   html += "<h1 class='lighttrack'>LED Control Panel</h1>";
 
+  html += "<p>Effect: <select onchange='setEffect(this.value)'>";
+  for (int e = 0; e < EFFECT_COUNT; e++) {
+    html += "<option"; if (e == effectIndex) html += " selected"; html += ">"; html += effectRegistry[e]->name(); html += "</option>";
+  }
+  html += "</select></p>";
+
+  html += "<p>Preset: <select id='presetSelect'>";
+  for (int i = 0; i < MAX_PRESETS; i++) {
+    if (presets[i].name[0] == 0) continue;
+    html += "<option"; if (i == activePreset) html += " selected"; html += ">"; html += presets[i].name; html += "</option>";
+  }
+  html += "</select> <button onclick='presetAction(\"activate\", document.getElementById(\"presetSelect\").value)'>Activate</button>";
+  html += " <button onclick='presetAction(\"delete\", document.getElementById(\"presetSelect\").value)'>Delete</button></p>";
+  html += "<p><input type='text' id='presetName' maxlength='15' placeholder='Preset name' style='width: 10em'>";
+  html += " <button onclick='presetAction(\"save\", document.getElementById(\"presetName\").value)'>Save Current</button></p>";
+
   html += "<input type='color' id='baseColorPicker' value='#";
   html += String((baseColor.r < 16 ? "0" : "") + String(baseColor.r, HEX));
   html += String((baseColor.g < 16 ? "0" : "") + String(baseColor.g, HEX));
@@ -735,6 +2334,12 @@ void handleRoot() {
   html += "<p>Center Shift (LEDs): <span id='centerShiftValue'>"; html += String(centerShift); html += "</span></p>";
   html += "<input type='range' min='-"; html += String(NUM_LEDS/2); html += "' max='"; html += String(NUM_LEDS/2); html += "' step='1' value='"; html += String(centerShift); html += "' oninput='document.getElementById(\"centerShiftValue\").innerText = this.value' onchange='setCenterShift(this.value)'>";
 
+  html += "<p>Speed Look-ahead (ms, 0=Off): <span id='lookAheadValue'>"; html += String(lookAheadMs); html += "</span></p>";
+  html += "<input type='range' min='0' max='"; html += String(LOOKAHEAD_MAX_MS); html += "' step='100' value='"; html += String(lookAheadMs); html += "' oninput='document.getElementById(\"lookAheadValue\").innerText = this.value' onchange='setLookAhead(this.value)'>";
+
+  html += "<p>Max Beams (people at once): <span id='maxBeamsValue'>"; html += String(maxBeams); html += "</span></p>";
+  html += "<input type='range' min='1' max='"; html += String(MAX_TARGETS); html += "' step='1' value='"; html += String(maxBeams); html += "' oninput='document.getElementById(\"maxBeamsValue\").innerText = this.value' onchange='setMaxBeams(this.value)'>";
+
   html += "<p>LED Off Delay (seconds): <span id='ledOffDelayValue'>"; html += String(ledOffDelay); html += "</span></p>";
   html += "<input type='range' min='1' max='60' step='1' value='"; html += String(ledOffDelay); html += "' oninput='document.getElementById(\"ledOffDelayValue\").innerText = this.value' onchange='setLedOffDelay(this.value)'>";
 
@@ -757,6 +2362,50 @@ void handleRoot() {
   html += "<div class='current-time'>Est. Local Time: <span id='currentTimeDisplay'>Loading...</span></div>";
   // ------------------------------------
 
+  html += "<hr>";
+  html += "<p>Color Temperature (K): <span id='kelvinValue'>"; html += String(colorKelvin); html += "</span></p>";
+  html += "<input type='range' min='"; html += String(KELVIN_MIN); html += "' max='"; html += String(KELVIN_MAX); html += "' step='100' value='"; html += String(colorKelvin); html += "' oninput='document.getElementById(\"kelvinValue\").innerText = this.value' onchange='setKelvin(this.value)'>";
+
+  html += "<p>Gamma (1.0 = Off): <span id='gammaValue'>"; html += String(colorGammaTenths / 10.0, 1); html += "</span></p>";
+  html += "<input type='range' min='1' max='3' step='0.1' value='"; html += String(colorGammaTenths / 10.0, 1); html += "' oninput='document.getElementById(\"gammaValue\").innerText = parseFloat(this.value).toFixed(1)' onchange='setGamma(this.value)'>";
+
+  html += "<p>Strip White Point:</p>";
+  html += "<input type='color' value='#";
+  html += String((whitePoint.r < 16 ? "0" : "") + String(whitePoint.r, HEX));
+  html += String((whitePoint.g < 16 ? "0" : "") + String(whitePoint.g, HEX));
+  html += String((whitePoint.b < 16 ? "0" : "") + String(whitePoint.b, HEX));
+  html += "' onchange='setWhitePoint(this.value)'>";
+
+  html += "<hr>";
+  html += "<p>Power Budget (mA, 0 = unlimited):</p>";
+  html += "<input type='number' min='0' max='"; html += String(POWER_BUDGET_MAX_MA); html += "' step='100' value='"; html += String(powerBudgetMa); html += "' onchange='setPowerBudget(this.value)'>";
+
+  html += "<hr>";
+  html += "<p>Transitions (ms, curve):</p>";
+  for (int e = 0; e < TRANSITION_EVENT_COUNT; e++) {
+    html += "<div>"; html += transitionEventNames[e]; html += " ";
+    html += "<input type='number' min='0' max='"; html += String(TRANSITION_MAX_MS); html += "' step='100' style='width: 6em' value='";
+    html += String(transitionSettings[e].durationMs); html += "' onchange='setTransition(\""; html += transitionEventNames[e]; html += "\", \"ms=\" + this.value)'>";
+    html += "<select onchange='setTransition(\""; html += transitionEventNames[e]; html += "\", \"curve=\" + this.value)'>";
+    for (int c = 0; c < CURVE_COUNT; c++) {
+      html += "<option"; if (c == transitionSettings[e].curve) html += " selected"; html += ">"; html += transitionCurveNames[c]; html += "</option>";
+    }
+    html += "</select></div>";
+  }
+
+  html += "<hr>";
+  html += "<p>Pixel Map (physical ranges in logical order, gapN for unlit stretches, e.g. 0-99,gap40,199-100):</p>";
+  html += "<input type='text' value='"; html += formatPixelRuns(); html += "' onchange='setPixelMap(this.value)'>";
+
+#ifdef LED_OUTPUT_RMT
+  html += "<p>Output Segments (pin:start:count, ...):</p>";
+  html += "<input type='text' value='"; html += formatSegmentLayout(); html += "' onchange='setSegments(this.value)'>";
+#endif
+
+  html += "<hr>";
+  html += "<p>Backup: <a href='/exportSettings'>Export JSON</a> | <a href='/exportSettings?format=bin'>Export binary</a></p>";
+  html += "<form method='POST' action='/importSettings' enctype='multipart/form-data'><input type='file' name='backup'> <input type='submit' value='Import'></form>";
+
   html += "<div class='footer'>DIY Yari</div>";
   html += "</div>"; // container
   html += "</body>";
@@ -766,6 +2415,221 @@ void handleRoot() {
 }
 
 
+// ------------------------- Settings Backup -------------------------
+// The whole configuration (everything in SettingsRecord, schedule and timezone
+// included) as one versioned blob, so a tuned device can be copied to others.
+// Two encodings of the same record: JSON, keyed like the settings store, and
+// the binary record behind its SettingsHeader. Import reads the blob over the
+// current settings, rejects it if any field is out of range, and otherwise
+// applies every field at once with a single writeSettings() pass; it never
+// goes through the per-field handlers.
+#define SETTINGS_BACKUP_MAX 1536 // Largest upload accepted; the JSON is well under 1 KB
+
+String settingsToJson(const SettingsRecord& r) {
+  String json = "{\"version\":"; json += SETTINGS_VERSION;
+  json += ",\"interval\":"; json += r.updateInterval;
+  json += ",\"offDelay\":"; json += r.ledOffDelay;
+  json += ",\"movingInt\":"; json += String(r.movingIntensity, 6);
+  json += ",\"stationaryInt\":"; json += String(r.stationaryIntensity, 6);
+  json += ",\"movingLength\":"; json += r.movingLength;
+  json += ",\"centerShift\":"; json += r.centerShift;
+  json += ",\"addLeds\":"; json += r.additionalLEDs;
+  json += ",\"baseColor\":["; json += r.baseColor.r; json += ","; json += r.baseColor.g; json += ","; json += r.baseColor.b; json += "]";
+  json += ",\"startHour\":"; json += r.startHour;
+  json += ",\"startMinute\":"; json += r.startMinute;
+  json += ",\"endHour\":"; json += r.endHour;
+  json += ",\"endMinute\":"; json += r.endMinute;
+  json += ",\"softness\":"; json += r.gradientSoftness;
+  json += ",\"tzOffset\":"; json += r.timezoneOffsetMinutes;
+  json += ",\"tzSet\":"; json += r.timezoneSet ? "true" : "false";
+  json += ",\"segments\":\""; json += formatSegmentLayout(r.outputSegments, r.outputSegmentCount); json += "\"";
+  json += ",\"pixelRuns\":\""; json += formatPixelRuns(r.pixelRuns, r.pixelRunCount); json += "\"";
+  json += ",\"transitions\":\""; json += formatTransitions(r.transitions); json += "\"";
+  json += ",\"powerBudget\":"; json += r.powerBudgetMa;
+  json += ",\"effect\":\""; json += effectName(r.effectIndex); json += "\"";
+  json += ",\"maxBeams\":"; json += r.maxBeams;
+  json += ",\"lookAhead\":"; json += r.lookAheadMs;
+  json += ",\"gamma\":"; json += r.colorGammaTenths;
+  json += ",\"kelvin\":"; json += r.colorKelvin;
+  json += ",\"whitePoint\":["; json += r.whitePoint.r; json += ","; json += r.whitePoint.g; json += ","; json += r.whitePoint.b; json += "]";
+  json += "}";
+  return json;
+}
+
+// Finds "key": in a flat JSON object and returns its value: the text inside
+// the quotes or brackets, or the bare token. False if the key is missing.
+bool findJsonValue(const String& json, const char* key, String& value) {
+  String quoted = String("\"") + key + "\"";
+  int length = json.length();
+  for (int at = json.indexOf(quoted); at >= 0; at = json.indexOf(quoted, at + 1)) {
+    int i = at + quoted.length();
+    while (i < length && isspace(json[i])) i++;
+    if (i >= length || json[i] != ':') continue; // A string value, not a key
+    i++;
+    while (i < length && isspace(json[i])) i++;
+    if (i < length && (json[i] == '"' || json[i] == '[')) {
+      int end = json.indexOf(json[i] == '"' ? '"' : ']', i + 1);
+      if (end < 0) return false;
+      value = json.substring(i + 1, end);
+    } else {
+      int end = i;
+      while (end < length && json[end] != ',' && json[end] != '}' && !isspace(json[end])) end++;
+      value = json.substring(i, end);
+    }
+    return true;
+  }
+  return false;
+}
+
+// Whole numbers only for integer fields, and nothing the field cannot hold
+template <typename T>
+bool parseJsonNumber(const String& text, T& out) {
+  char* end;
+  double n = strtod(text.c_str(), &end);
+  if (end == text.c_str() || *end != 0) return false;
+  if (!(n >= (double)std::numeric_limits<T>::lowest() && n <= (double)std::numeric_limits<T>::max())) return false; // Also rejects NaN
+  if (std::numeric_limits<T>::is_integer && n != floor(n)) return false;
+  out = n;
+  return true;
+}
+
+bool parseJsonBool(const String& text, bool& out) {
+  if (text != "true" && text != "false") return false;
+  out = (text == "true");
+  return true;
+}
+
+// "r,g,b" from a [r,g,b] array
+bool parseJsonColor(const String& text, CRGB& out) {
+  unsigned int r, g, b;
+  char extra;
+  if (sscanf(text.c_str(), " %u , %u , %u %c", &r, &g, &b, &extra) != 3 || r > 255 || g > 255 || b > 255) return false;
+  out = CRGB(r, g, b);
+  return true;
+}
+
+// Reads a settingsToJson() blob over r; keys that are missing keep r's value.
+// Returns NULL, or the key whose value could not be read.
+const char* settingsFromJson(const String& json, SettingsRecord& r) {
+  String value;
+  int version = 0;
+  if (!findJsonValue(json, "version", value) || !parseJsonNumber(value, version) || version != SETTINGS_VERSION) return "version";
+#define IMPORT_FIELD(key, ok) if (findJsonValue(json, key, value) && !(ok)) return key
+  IMPORT_FIELD("interval", parseJsonNumber(value, r.updateInterval));
+  IMPORT_FIELD("offDelay", parseJsonNumber(value, r.ledOffDelay));
+  IMPORT_FIELD("movingInt", parseJsonNumber(value, r.movingIntensity));
+  IMPORT_FIELD("stationaryInt", parseJsonNumber(value, r.stationaryIntensity));
+  IMPORT_FIELD("movingLength", parseJsonNumber(value, r.movingLength));
+  IMPORT_FIELD("centerShift", parseJsonNumber(value, r.centerShift));
+  IMPORT_FIELD("addLeds", parseJsonNumber(value, r.additionalLEDs));
+  IMPORT_FIELD("baseColor", parseJsonColor(value, r.baseColor));
+  IMPORT_FIELD("startHour", parseJsonNumber(value, r.startHour));
+  IMPORT_FIELD("startMinute", parseJsonNumber(value, r.startMinute));
+  IMPORT_FIELD("endHour", parseJsonNumber(value, r.endHour));
+  IMPORT_FIELD("endMinute", parseJsonNumber(value, r.endMinute));
+  IMPORT_FIELD("softness", parseJsonNumber(value, r.gradientSoftness));
+  IMPORT_FIELD("tzOffset", parseJsonNumber(value, r.timezoneOffsetMinutes));
+  IMPORT_FIELD("tzSet", parseJsonBool(value, r.timezoneSet));
+  if (findJsonValue(json, "segments", value)) {
+    memset(r.outputSegments, 0, sizeof(r.outputSegments));
+    if (!parseSegmentLayout(value, r.outputSegments, r.outputSegmentCount)) return "segments";
+  }
+  if (findJsonValue(json, "pixelRuns", value)) {
+    memset(r.pixelRuns, 0, sizeof(r.pixelRuns));
+    if (!parsePixelRuns(value, r.pixelRuns, r.pixelRunCount)) return "pixelRuns";
+  }
+  IMPORT_FIELD("transitions", parseTransitions(value, r.transitions));
+  IMPORT_FIELD("powerBudget", parseJsonNumber(value, r.powerBudgetMa));
+  if (findJsonValue(json, "effect", value)) {
+    int index = findEffect(value);
+    if (index < 0) return "effect";
+    r.effectIndex = index;
+  }
+  IMPORT_FIELD("maxBeams", parseJsonNumber(value, r.maxBeams));
+  IMPORT_FIELD("lookAhead", parseJsonNumber(value, r.lookAheadMs));
+  IMPORT_FIELD("gamma", parseJsonNumber(value, r.colorGammaTenths));
+  IMPORT_FIELD("kelvin", parseJsonNumber(value, r.colorKelvin));
+  IMPORT_FIELD("whitePoint", parseJsonColor(value, r.whitePoint));
+#undef IMPORT_FIELD
+  return NULL;
+}
+
+// The record behind its header, as the EEPROM record was laid out. Only
+// meaningful to this firmware family (same struct layout and endianness).
+size_t settingsToBinary(const SettingsRecord& r, uint8_t* out) {
+  SettingsHeader header = { SETTINGS_MAGIC, SETTINGS_VERSION, sizeof(SettingsRecord), crc32Update(0, (const uint8_t*)&r, sizeof(r)) };
+  memcpy(out, &header, sizeof(header));
+  memcpy(out + sizeof(header), &r, sizeof(r));
+  return sizeof(header) + sizeof(r);
+}
+
+// Reads a settingsToBinary() blob over r. A shorter record (from older
+// firmware, fields are only appended) leaves the rest of r as it is.
+const char* settingsFromBinary(const uint8_t* data, size_t length, SettingsRecord& r) {
+  SettingsHeader header;
+  if (length < sizeof(header)) return "header";
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != SETTINGS_MAGIC || header.version != SETTINGS_VERSION) return "version";
+  if (header.length == 0 || header.length > sizeof(r) || sizeof(header) + header.length != length) return "length";
+  if (crc32Update(0, data + sizeof(header), header.length) != header.crc) return "crc";
+  memcpy((void*)&r, data + sizeof(header), header.length);
+  return NULL;
+}
+
+// Applies r if every field is in range, and returns how many are not (0 =
+// applied). Holds settingsWriteLock throughout, so a pending write-behind
+// flush cannot interleave; anything it had pending is superseded. The store
+// write is journaled: power lost partway through boots into all of the
+// backup or all of the settings from before, never a mix.
+int importSettings(const SettingsRecord& r) {
+  SettingsRecord current;
+  captureSettings(current);
+  SettingsRecord checked = r;
+  int invalid = repairSettings(checked, current);
+  if (invalid > 0) return invalid;
+
+  xSemaphoreTake(settingsWriteLock, portMAX_DELAY);
+  portENTER_CRITICAL(&ledOutputMux); // The LED task reads the segment layout under this lock
+  applySettings(r);
+  outputLayoutChanged = true;
+  portEXIT_CRITICAL(&ledOutputMux);
+  portENTER_CRITICAL(&settingsMux);
+  settingsDirty = false;
+  settingsState.stats.flushes++;
+  portEXIT_CRITICAL(&settingsMux);
+  SettingsRecord imported;
+  captureSettings(imported);
+  logSettingsWrite(writeSettingsJournaled(settingsStore, settingsState, imported));
+  xSemaphoreGive(settingsWriteLock);
+
+  pixelMapChanged = true;
+  activePreset = -1;
+  publishRenderConstants();
+  updateTime(); // The schedule or timezone may have changed
+  wakeRenderer();
+  return 0;
+}
+
+// File uploads to /importSettings are collected here before the handler runs
+uint8_t importBuffer[SETTINGS_BACKUP_MAX + 1]; // +1 for a terminator when it is JSON
+size_t importLength = 0;
+bool importTooLarge = false;
+
+void handleImportUpload() {
+  HTTPUpload& upload = server.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    importLength = 0;
+    importTooLarge = false;
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (importLength + upload.currentSize > SETTINGS_BACKUP_MAX) {
+      importTooLarge = true;
+    } else {
+      memcpy(importBuffer + importLength, upload.buf, upload.currentSize);
+      importLength += upload.currentSize;
+    }
+  }
+}
+
 // ------------------------- HTTP Handlers (Settings) -------------------------
 // (No changes needed for these handlers)
 void handleSetInterval() {
@@ -773,6 +2637,7 @@ void handleSetInterval() {
     updateInterval = server.arg("value").toInt();
     if(updateInterval < 10) updateInterval = 10;
     Serial.print("Update interval set to: "); Serial.println(updateInterval);
+    publishRenderConstants();
     saveSettings();
   }
   server.sendHeader("Location", "/");
@@ -783,6 +2648,7 @@ void handleSetLedOffDelay() {
     ledOffDelay = server.arg("value").toInt();
     ledOffDelay = constrain(ledOffDelay, 1, 60);
     Serial.print("LED off delay set to: "); Serial.println(ledOffDelay);
+    publishRenderConstants();
     saveSettings();
   }
   server.sendHeader("Location", "/");
@@ -792,6 +2658,7 @@ void handleSetBaseColor() {
   if (server.hasArg("r") && server.hasArg("g") && server.hasArg("b")) {
     baseColor = CRGB(server.arg("r").toInt(), server.arg("g").toInt(), server.arg("b").toInt());
     Serial.print("Base color set to RGB: "); Serial.print(baseColor.r); Serial.print(", "); Serial.print(baseColor.g); Serial.print(", "); Serial.println(baseColor.b);
+    publishRenderConstants();
     saveSettings();
   }
  // No redirect needed for color change - async update
@@ -802,6 +2669,7 @@ void handleSetMovingLength() {
     movingLength = server.arg("value").toInt();
     movingLength = constrain(movingLength, 1, NUM_LEDS);
     Serial.print("Moving length set to: "); Serial.println(movingLength);
+    publishRenderConstants();
     saveSettings();
   }
  // No redirect needed - async update
@@ -812,6 +2680,7 @@ void handleSetAdditionalLEDs() {
     additionalLEDs = server.arg("value").toInt();
     additionalLEDs = constrain(additionalLEDs, 0, NUM_LEDS / 2);
     Serial.print("Additional LEDs set to: "); Serial.println(additionalLEDs);
+    publishRenderConstants();
     saveSettings();
   }
  // No redirect needed - async update
@@ -822,6 +2691,7 @@ void handleSetCenterShift() {
     centerShift = server.arg("value").toInt();
     centerShift = constrain(centerShift, -NUM_LEDS / 2, NUM_LEDS / 2);
     Serial.print("Center shift set to: "); Serial.println(centerShift);
+    publishRenderConstants();
     saveSettings();
   }
  // No redirect needed - async update
@@ -833,6 +2703,7 @@ void handleSetMovingIntensity() {
     float val_percent = server.arg("value").toFloat();
     movingIntensity = constrain(val_percent / 100.0, 0.0, 1.0);
     Serial.print("Moving intensity set to: "); Serial.print(movingIntensity * 100.0, 0); Serial.println("%");
+    publishRenderConstants();
     saveSettings();
   }
  // No redirect needed - async update
@@ -843,6 +2714,7 @@ void handleSetStationaryIntensity() {
     float val_percent = server.arg("value").toFloat();
     stationaryIntensity = constrain(val_percent / 100.0, 0.0, 0.1);
     Serial.print("Stationary intensity set to: "); Serial.print(stationaryIntensity * 100.0, 1); Serial.println("%");
+    publishRenderConstants();
     saveSettings();
   }
  // No redirect needed - async update
@@ -854,11 +2726,180 @@ void handleSetGradientSoftness() {
     gradientSoftness = server.arg("value").toInt();
     gradientSoftness = constrain(gradientSoftness, 0, 10);
     Serial.print("Gradient Softness set to: "); Serial.println(gradientSoftness);
+    publishRenderConstants();
     saveSettings();
   }
  // No redirect needed - async update
   server.send(200, "text/plain", "OK");
 }
+void handleSetPowerBudget() {
+  if (server.hasArg("value")) {
+    long value = server.arg("value").toInt();
+    powerBudgetMa = (value <= 0) ? 0 : constrain(value, (long)POWER_BUDGET_MIN_MA, (long)POWER_BUDGET_MAX_MA);
+    Serial.print("Power budget set to: "); Serial.print(powerBudgetMa); Serial.println(powerBudgetMa ? " mA" : " (unlimited)");
+    publishRenderConstants();
+    saveSettings();
+  }
+ // No redirect needed - async update
+  server.send(200, "text/plain", "OK");
+}
+void handleSetEffect() {
+  int index = findEffect(server.arg("name"));
+  if (index < 0) {
+    server.send(400, "text/plain", "Unknown effect");
+    return;
+  }
+  effectIndex = index;
+  Serial.print("Effect set to: "); Serial.println(effectName(effectIndex));
+  publishRenderConstants();
+  saveSettings();
+  server.send(200, "text/plain", "OK");
+}
+void handleSavePreset() {
+  String name = server.arg("name");
+  if (!isValidPresetName(name)) {
+    server.send(400, "text/plain", "Invalid preset name");
+    return;
+  }
+  int index = savePreset(name);
+  if (index < 0) {
+    server.send(409, "text/plain", "All preset slots are used");
+    return;
+  }
+  activePreset = index;
+  Serial.print("Preset saved: "); Serial.println(name);
+  server.send(200, "text/plain", "OK");
+}
+void handleActivatePreset() {
+  int index = findPreset(server.arg("name"));
+  if (index < 0) {
+    server.send(404, "text/plain", "Unknown preset");
+    return;
+  }
+  activatePreset(index);
+  Serial.print("Preset activated: "); Serial.println(presets[index].name);
+  server.send(200, "text/plain", "OK");
+}
+void handleDeletePreset() {
+  int index = findPreset(server.arg("name"));
+  if (index < 0) {
+    server.send(404, "text/plain", "Unknown preset");
+    return;
+  }
+  Serial.print("Preset deleted: "); Serial.println(presets[index].name);
+  memset((void*)&presets[index], 0, sizeof(ScenePreset));
+  storePreset(index);
+  if (activePreset == index) {
+    activePreset = -1;
+    saveSettings(); // The look it left on the strip becomes the settings' own
+  }
+  server.send(200, "text/plain", "OK");
+}
+void handleSetMaxBeams() {
+  if (server.hasArg("value")) {
+    maxBeams = constrain(server.arg("value").toInt(), 1, MAX_TARGETS);
+    Serial.print("Max beams set to: "); Serial.println(maxBeams);
+    publishRenderConstants();
+    saveSettings();
+  }
+ // No redirect needed - async update
+  server.send(200, "text/plain", "OK");
+}
+void handleSetLookAhead() {
+  if (server.hasArg("value")) {
+    lookAheadMs = constrain(server.arg("value").toInt(), 0, LOOKAHEAD_MAX_MS);
+    Serial.print("Look-ahead set to: "); Serial.print(lookAheadMs); Serial.println(lookAheadMs ? " ms" : " (off)");
+    publishRenderConstants();
+    saveSettings();
+  }
+ // No redirect needed - async update
+  server.send(200, "text/plain", "OK");
+}
+// Colour pipeline handlers
+void handleSetGamma() {
+  if (server.hasArg("value")) {
+    colorGammaTenths = constrain((int)(server.arg("value").toFloat() * 10.0 + 0.5), 10, 30);
+    Serial.print("Color gamma set to: "); Serial.println(colorGammaTenths / 10.0, 1);
+    publishRenderConstants();
+    saveSettings();
+  }
+ // No redirect needed - async update
+  server.send(200, "text/plain", "OK");
+}
+void handleSetKelvin() {
+  if (server.hasArg("value")) {
+    colorKelvin = constrain(server.arg("value").toInt(), KELVIN_MIN, KELVIN_MAX);
+    Serial.print("Color temperature set to: "); Serial.print(colorKelvin); Serial.println(" K");
+    publishRenderConstants();
+    saveSettings();
+  }
+ // No redirect needed - async update
+  server.send(200, "text/plain", "OK");
+}
+void handleSetWhitePoint() {
+  if (server.hasArg("r") && server.hasArg("g") && server.hasArg("b")) {
+    whitePoint = CRGB(server.arg("r").toInt(), server.arg("g").toInt(), server.arg("b").toInt());
+    Serial.print("White point set to RGB: "); Serial.print(whitePoint.r); Serial.print(", "); Serial.print(whitePoint.g); Serial.print(", "); Serial.println(whitePoint.b);
+    publishRenderConstants();
+    saveSettings();
+  }
+ // No redirect needed - async update
+  server.send(200, "text/plain", "OK");
+}
+// Downloads the whole configuration: /exportSettings (JSON) or /exportSettings?format=bin
+void handleExportSettings() {
+  SettingsRecord r;
+  captureSettings(r);
+  if (server.arg("format") == "bin") {
+    uint8_t blob[sizeof(SettingsHeader) + sizeof(SettingsRecord)];
+    size_t length = settingsToBinary(r, blob);
+    server.sendHeader("Content-Disposition", "attachment; filename=lighttrack-settings.bin");
+    server.send_P(200, "application/octet-stream", (const char*)blob, length);
+  } else {
+    server.sendHeader("Content-Disposition", "attachment; filename=lighttrack-settings.json");
+    server.send(200, "application/json", settingsToJson(r));
+  }
+}
+// Restores an /exportSettings blob: a file upload (JSON or binary, told apart
+// by the first byte) or a JSON request body. Nothing changes unless all of it is valid.
+void handleImportSettings() {
+  SettingsRecord r;
+  captureSettings(r);
+  bool uploaded = importLength > 0 || importTooLarge;
+  const char* bad = NULL;
+  const char* format = "JSON";
+  if (importTooLarge) {
+    bad = "size";
+  } else if (uploaded && importBuffer[0] == '{') {
+    importBuffer[importLength] = 0;
+    bad = settingsFromJson(String((const char*)importBuffer), r);
+  } else if (uploaded) {
+    format = "binary";
+    bad = settingsFromBinary(importBuffer, importLength, r);
+  } else if (server.hasArg("plain")) {
+    bad = settingsFromJson(server.arg("plain"), r);
+  } else {
+    bad = "missing";
+  }
+  importLength = 0;
+  importTooLarge = false;
+  if (bad) {
+    server.send(400, "text/plain", String("Invalid backup: ") + bad);
+    return;
+  }
+  int invalid = importSettings(r);
+  if (invalid > 0) {
+    server.send(400, "text/plain", String("Backup rejected: ") + invalid + " setting(s) out of range, nothing changed");
+    return;
+  }
+  Serial.print("Settings imported from "); Serial.println(format);
+  if (uploaded) { // From the form on the main page
+    server.sendHeader("Location", "/");
+    server.send(303);
+  } else {
+    server.send(200, "text/plain", "OK");
+  }
+}
 
 
 // ------------------------- OTA Setup Function -------------------------
@@ -866,15 +2907,24 @@ void setupOTA() {
   ArduinoOTA.onStart([]() {
     String type = ArduinoOTA.getCommand() == U_FLASH ? "sketch" : "filesystem";
     Serial.println("Start updating " + type);
+    flushSettings(); // The update reboots the device when it ends
+    otaProgressPercent = 0;
+    wakeRenderer();
   });
   ArduinoOTA.onEnd([]() {
+    otaProgressPercent = -1;
     Serial.println("\nEnd");
   });
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
+    // Scaled before dividing: total / 100 is zero for images under 100 bytes
+    uint32_t percent = (total > 0) ? min((uint32_t)progress * 100 / total, (uint32_t)100) : 0;
+    Serial.printf("Progress: %u%%\r", (unsigned int)percent);
+    otaProgressPercent = percent;
+    wakeRenderer();
   });
   ArduinoOTA.onError([](ota_error_t error) {
     Serial.printf("Error[%u]: ", error);
+    otaProgressPercent = -1;
     if (error == OTA_AUTH_ERROR) Serial.println("Auth Failed");
     else if (error == OTA_BEGIN_ERROR) Serial.println("Begin Failed");
     else if (error == OTA_CONNECT_ERROR) Serial.println("Connect Failed");
@@ -896,59 +2946,59 @@ void setupOTA() {
 
 // ------------------------- Setup -------------------------
 void setup() {
+  // Fast path to first light: only what the first frame needs runs before the
+  // tasks start; the network side comes up while the strip is already lit
   Serial.begin(115200);
-  delay(500);
-  Serial.println("\n\n--------------------------------------");
-  Serial.println("ESP32-C3 LightTrack Starting (Local Time Schedule)");
-  Serial.println("--------------------------------------");
+  Serial.println("\n--- ESP32-C3 LightTrack Starting (Local Time Schedule) ---");
+  markBootPhase("serial");
 
   // Initialize random number generator
   uint64_t chipid = ESP.getEfuseMac();
   randomSeed((unsigned long)chipid ^ (unsigned long)(chipid >> 32));
-  
-  // Initialize LEDs immediately
-  Serial.println("Initializing LED Strip (FastLED)...");
-  FastLED.addLeds<CHIPSET, LED_PIN, COLOR_ORDER>(leds, NUM_LEDS).setCorrection(TypicalLEDStrip);
-  FastLED.setBrightness(255);
-  FastLED.clear(); 
-  leds[0] = CRGB::White;
-  FastLED.show();
-  
-  // Initialize SPIFFS and load settings
-  Serial.println("Initializing SPIFFS & EEPROM...");
-  if (!SPIFFS.begin(true)) {
-    Serial.println("!!! Failed to mount SPIFFS. Formatting...");
-    if (!SPIFFS.begin(true)) {
-      Serial.println("!!! SPIFFS Format failed. Continuing anyway.");
-    }
-  }
+
+  Serial.print("Initializing LED Strip ("); Serial.print(ledOutputDriverName()); Serial.println(")...");
+  setupLedOutput();
+  markBootPhase("leds");
+
   loadSettings();
-  
-  // Initialize sensor
-  Serial.println("Initializing Radar Sensor (Serial1)...");
-  Serial1.begin(256000, SERIAL_8N1, 20, 21);
-  
-  // Set up WiFi
+  settingsWriteLock = xSemaphoreCreateMutex(); // Before any task can flush
+  loadPresets();
+  loadRuntimeState();
+  buildEasingLut();
+  publishRenderConstants();
+  markBootPhase("settings");
+
+  // Must precede the LED task, whose idle path takes and releases the PM lock
+  setupPowerManagement();
+
+  // Start rendering from the persisted settings right away
+  beginSensorUart();
+  xTaskCreatePinnedToCore(sensorTask, "Sensor Task", 2048, NULL, 2, NULL, 1);
+  xTaskCreatePinnedToCore(ledTask, "LED Task", 8192, NULL, 1, &ledTaskHandle, 1);
+  markBootPhase("render");
+
+  // Everything below runs while the LED task is drawing
   Serial.println("Setting up WiFi AP Mode...");
   setupWiFi();
+  markBootPhase("wifi");
 
   // Start NTP without blocking
-  Serial.println("Setting up NTP time synchronization (async)...");
   configTzTime("UTC0", "pool.ntp.org", "time.nist.gov");
+  markBootPhase("ntp");
 
-  // Set up OTA
   Serial.println("Setting up OTA Updates...");
   setupOTA();
-  
-  // Turn off indicator LED
-  leds[0] = CRGB::Black;
-  FastLED.show();
-  
-  // Create tasks
-  Serial.println("Creating RTOS Tasks...");
-  xTaskCreatePinnedToCore(sensorTask, "Sensor Task", 2048, NULL, 2, NULL, 1);
-  xTaskCreatePinnedToCore(ledTask, "LED Task", 8192, NULL, 1, NULL, 1);
+  markBootPhase("ota");
+
+  // Nothing reads SPIFFS yet, so a first-boot format no longer delays the strip
+  if (!SPIFFS.begin(true)) {
+    Serial.println("!!! Failed to mount SPIFFS. Continuing anyway.");
+  }
+  markBootPhase("spiffs");
+
   xTaskCreatePinnedToCore(webServerTask, "WebServer Task", 4096, NULL, 1, NULL, 0);
+  markBootPhase("ready");
+  logBootPhases();
 
   Serial.println("--------------------------------------");
   Serial.println("Setup Complete. System Running.");
@@ -961,6 +3011,8 @@ void setup() {
 // ------------------------- Loop -------------------------
 void loop() {
   updateTime(); // Check schedule using local time calculation
+  flushSettingsIfQuiet();
+  saveRuntimeStateIfChanged();
 
   // Optional status logging
   static unsigned long lastLoopLog = 0;
@@ -998,6 +3050,21 @@ void loop() {
       Serial.print("Moving Intensity: "); Serial.print(movingIntensity * 100.0, 0); Serial.println("%");
       Serial.print("Stationary Intensity: "); Serial.print(stationaryIntensity * 100.0, 1); Serial.println("%");
       Serial.print("Gradient Softness: "); Serial.println(gradientSoftness);
+      Serial.printf("LED output (%s): last %u us, max %u us, glitches %u, overruns %u\n",
+                    ledOutputDriverName(), ledOutputStats.lastTransmitUs, ledOutputStats.maxTransmitUs,
+                    ledOutputStats.glitches, ledOutputStats.overruns);
+      Serial.printf("Power: %.2f W (%u mA, requested %u mA, budget %u mA), %.4f Wh\n",
+                    powerStats.drawnMa * LED_SUPPLY_VOLTS / 1000.0, powerStats.drawnMa, powerStats.requestedMa,
+                    powerBudgetMa, powerStats.chargeMaMs * LED_SUPPLY_VOLTS / 3.6e9);
+      uint64_t idleMs = totalIdleMs();
+      Serial.printf("Idle: %lu s (%.1f%% of uptime), %u entries, PM %s\n",
+                    (unsigned long)(idleMs / 1000), millis() ? idleMs * 100.0 / millis() : 0.0, idleStats.entries,
+                    powerManagementOn ? "ON" : "OFF");
+      Serial.printf("Settings: %u changes, %u flushes, %u keys (%u bytes) written%s\n", settingsState.stats.saves,
+                    settingsState.stats.flushes, settingsState.stats.keyWrites, settingsState.stats.bytes,
+                    settingsDirty ? " (write pending)" : "");
+      Serial.printf("Runtime state: seq %u, %u writes, %s at boot; first frame %.1f ms after app start\n", runtimeStats.seq,
+                    runtimeStats.writes, runtimeStats.restored ? "restored" : "defaults", runtimeStats.firstFrameAppUs / 1000.0);
       Serial.print("Free heap: "); Serial.println(ESP.getFreeHeap());
       Serial.println("---------------------");
   }
@@ -0,0 +1,159 @@
+#ifndef LIGHTTRACK_BENCHMARK_H
+#define LIGHTTRACK_BENCHMARK_H
+// Render benchmark sweep, shared by test/render_benchmark on the host and the
+// /benchmark endpoint of a -DRENDER_BENCHMARK build. Times the background
+// fill and the beam draw on their own, for strip lengths up to
+// BENCHMARK_MAX_LEDS, beam lengths from 1 to NUM_LEDS and every
+// gradientSoftness, and the per-settings shape rebuild that feeds them. Each
+// sub-pixel "beam" row has a "beamInteger" row beside it for the old
+// whole-pixel beam, and "layers0".."layers4" give the whole effect's cost
+// against its number of layers. Rows are CSV with ns per frame and per pixel (strip
+// pixels for the fill, drawn pixels for the beams).
+//
+// Clock is as for the snapshots, plus static uint32_t floatCalls(): the
+// soft-float library calls made so far, or 0 where they are not counted.
+// Out takes each CSV line in row(const char*) and gets flush() after every
+// strip length.
+#include <stdio.h>
+#include "LightTrackRender.h"
+
+#define BENCHMARK_MAX_LEDS 2000
+#define BENCHMARK_REPEATS  16
+const int benchmarkStrips[] = { 60, 150, 300, 600, 1000, BENCHMARK_MAX_LEDS };
+
+#define BENCHMARK_CSV_HEADER "pass,stripLeds,beamLeds,gradientSoftness,nsPerFrame,nsPerPixel,softFloatCalls\n"
+
+// Beam lengths 1, 2, 4, ... and then NUM_LEDS itself
+inline int nextBenchmarkBeam(int length) {
+  return (length < NUM_LEDS && length * 2 > NUM_LEDS) ? NUM_LEDS : length * 2;
+}
+
+// Baseline for the "beamInteger" rows: the whole-pixel beam that BeamLayer's
+// sub-pixel positioning replaced, with the float position rounded to an LED
+// and the profile sampled once per pixel. Only the benchmark draws it.
+struct IntegerBeamLayer {
+  uint8_t alpha = 255;
+  const RenderConstants* k;
+  CRGB color;
+  int leftLED;
+  int length;
+
+  static int count(const FrameContext& f) { return f.beamCount; }
+
+  bool begin(const FrameContext& f, int index, int& first, int& last) {
+    const BeamTarget& beam = f.beams[index];
+    k = f.k;
+    color = scaleColorQ8(k->beamColor, beam.level);
+    float prop = constrain((float)((int)beam.distance - MIN_DISTANCE) / (MAX_DISTANCE - MIN_DISTANCE), 0.0f, 1.0f);
+    int center = constrain((int)round(prop * (f.count - 1)) + k->centerShift, 0, f.count - 1);
+    length = k->totalLightLength + beam.extension;
+    leftLED = center - (beam.direction > 0 ? k->tailOffset : k->headOffset + beam.extension);
+    first = leftLED;
+    last = leftLED + length - 1;
+    return true;
+  }
+
+  inline CRGB shade(int i) { return scaleColorQ8(color, beamProfile(*k, i - leftLED, length)); }
+};
+
+// One CSV row; ticks and float calls are totals over BENCHMARK_REPEATS
+template <class Clock, class Out>
+void benchmarkRow(Out& out, const char* pass, int strip, int beam, int softness,
+                  uint32_t ticks, uint32_t floatCalls, int pixels) {
+  float ns = (float)ticks * 1000.0f / Clock::ticksPerUs() / BENCHMARK_REPEATS;
+  char line[96];
+  snprintf(line, sizeof(line), "%s,%d,%d,%d,%.0f,%.2f,%u\n", pass, strip, beam, softness,
+           ns, pixels > 0 ? ns / pixels : 0.0f, (unsigned)(floatCalls / BENCHMARK_REPEATS));
+  out.row(line);
+}
+
+// Compositor rows: a 30-LED beam at gradientSoftness 7, drawn by 0 to 4
+// layers over the background, through the effect's virtual render() as
+// ledTask calls it. Each layer uses a different blend, so all three are costed.
+#define BENCHMARK_LAYER_BEAM     30
+#define BENCHMARK_LAYER_SOFTNESS 7
+
+// Runs the whole sweep over pixels[BENCHMARK_MAX_LEDS]
+template <class Clock, class Out>
+void runRenderBenchmark(CRGB* pixels, Out& out) {
+  RenderConstants k;
+  memset((void*)&k, 0, sizeof(k));
+  k.background16[0] = 0x2000; k.background16[1] = 0x1000; k.background16[2] = 0x0800;
+  k.beamColor = CRGB(255, 128, 64);
+
+  FrameContext f;
+  f.k = &k;
+  f.pixels = pixels;
+  f.beamCount = 1;
+  f.masterLevel = 256;
+  f.backgroundLevel = 256;
+  f.frame = 0;
+  BeamTarget& beam = f.beams[0];
+  beam.distance = (MIN_DISTANCE + MAX_DISTANCE) / 2;
+  beam.direction = 1;
+  beam.level = 256;
+  beam.extension = 0;
+
+  LayeredEffect<BackgroundPass<true> > layers0("layers0");
+  LayeredEffect<BackgroundPass<true>, LayerPass<BeamLayer, BlendMax> > layers1("layers1");
+  LayeredEffect<BackgroundPass<true>, LayerPass<BeamLayer, BlendMax>, LayerPass<BeamLayer, BlendAdd> > layers2("layers2");
+  LayeredEffect<BackgroundPass<true>, LayerPass<BeamLayer, BlendMax>, LayerPass<BeamLayer, BlendAdd>,
+                LayerPass<BeamLayer, BlendAlpha> > layers3("layers3");
+  LayeredEffect<BackgroundPass<true>, LayerPass<BeamLayer, BlendMax>, LayerPass<BeamLayer, BlendAdd>,
+                LayerPass<BeamLayer, BlendAlpha>, LayerPass<BeamLayer, BlendMax> > layers4("layers4");
+  Effect* const layerEffects[] = { &layers0, &layers1, &layers2, &layers3, &layers4 };
+
+  // Shape rebuild, once per settings change rather than per frame
+  for (int beamLength = 1; beamLength <= NUM_LEDS; beamLength = nextBenchmarkBeam(beamLength)) {
+    for (int softness = 0; softness <= 10; softness++) {
+      uint32_t floats = Clock::floatCalls();
+      uint32_t start = Clock::ticks();
+      for (int r = 0; r < BENCHMARK_REPEATS; r++) computeBeamShape(k, beamLength, 0, softness, 0);
+      uint32_t ticks = Clock::ticks() - start;
+      benchmarkRow<Clock>(out, "shape", 0, beamLength, softness, ticks, Clock::floatCalls() - floats, 0);
+    }
+  }
+  out.flush();
+
+  for (size_t s = 0; s < sizeof(benchmarkStrips) / sizeof(benchmarkStrips[0]); s++) {
+    f.count = benchmarkStrips[s];
+
+    uint32_t floats = Clock::floatCalls();
+    uint32_t start = Clock::ticks();
+    for (int r = 0; r < BENCHMARK_REPEATS; r++) BackgroundPass<true>::render(f);
+    uint32_t ticks = Clock::ticks() - start;
+    benchmarkRow<Clock>(out, "background", f.count, 0, 0, ticks, Clock::floatCalls() - floats, f.count);
+
+    for (int beamLength = 1; beamLength <= NUM_LEDS; beamLength = nextBenchmarkBeam(beamLength)) {
+      for (int softness = 0; softness <= 10; softness++) {
+        computeBeamShape(k, beamLength, 0, softness, 0);
+        int drawn = min(k.totalLightLength + 1, f.count); // The span includes the fractional end pixel
+        floats = Clock::floatCalls();
+        start = Clock::ticks();
+        for (int r = 0; r < BENCHMARK_REPEATS; r++) LayerPass<BeamLayer, BlendMax>::render(f);
+        ticks = Clock::ticks() - start;
+        benchmarkRow<Clock>(out, "beam", f.count, beamLength, softness, ticks, Clock::floatCalls() - floats, drawn);
+
+        floats = Clock::floatCalls();
+        start = Clock::ticks();
+        for (int r = 0; r < BENCHMARK_REPEATS; r++) LayerPass<IntegerBeamLayer, BlendMax>::render(f);
+        ticks = Clock::ticks() - start;
+        benchmarkRow<Clock>(out, "beamInteger", f.count, beamLength, softness, ticks, Clock::floatCalls() - floats,
+                            min(k.totalLightLength, f.count));
+      }
+    }
+
+    computeBeamShape(k, BENCHMARK_LAYER_BEAM, 0, BENCHMARK_LAYER_SOFTNESS, 0);
+    for (size_t n = 0; n < sizeof(layerEffects) / sizeof(layerEffects[0]); n++) {
+      floats = Clock::floatCalls();
+      start = Clock::ticks();
+      for (int r = 0; r < BENCHMARK_REPEATS; r++) layerEffects[n]->render(f);
+      ticks = Clock::ticks() - start;
+      benchmarkRow<Clock>(out, layerEffects[n]->name(), f.count, BENCHMARK_LAYER_BEAM, BENCHMARK_LAYER_SOFTNESS,
+                          ticks, Clock::floatCalls() - floats, f.count);
+    }
+    out.flush();
+  }
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef LIGHTTRACK_COMMON_H
+#define LIGHTTRACK_COMMON_H
+// Build configuration and small helpers shared by the sketch and the host
+// tests in test/. Change the strip and sensor setup here.
+#include <stddef.h>
+#include <stdint.h>
+
+// ------------------------- LED Configuration -------------------------
+#define LED_PIN             2
+#define NUM_LEDS            300
+#define CHIPSET             WS2812B
+#define COLOR_ORDER         GRB
+// Power model per LED (same figures as FastLED's power_mgt): mA per channel at 255, plus quiescent
+#define LED_SUPPLY_VOLTS    5
+#define LED_MA_RED          16
+#define LED_MA_GREEN        11
+#define LED_MA_BLUE         15
+#define LED_MA_IDLE         1
+#define POWER_BUDGET_MIN_MA 500
+#define POWER_BUDGET_MAX_MA 20000
+#define KELVIN_MIN          1900
+#define KELVIN_MAX          10000
+
+// ------------------------- Sensor Parameters -------------------------
+#define SENSOR_HEADER       0xAA
+#define MIN_DISTANCE        20
+#define MAX_DISTANCE        1000
+#define DEFAULT_DISTANCE    1000
+#define NOISE_THRESHOLD     5
+#define SENSOR_RX_PIN       20
+#define SENSOR_TX_PIN       21
+#define MAX_TARGETS         4    // People tracked (and beams drawn) at once
+#define TRACK_GATE_CM       100  // Largest jump still treated as the same person
+#define TRACK_LOST_MS       2000 // Unseen this long and faded out: the track is dropped
+#define VELOCITY_WINDOW_MS  100  // Speed is measured over at least this long, so sensor jitter averages out
+#define VELOCITY_DEADBAND   30   // cm/s treated as standing still
+#define LOOKAHEAD_MAX_MS    2000
+#define LOOKAHEAD_MAX_LEDS  60   // Upper bound on the velocity extension
+#define LOOKAHEAD_GROW_Q8   128  // Extension slew per frame in 1/256 LED: grows quickly...
+#define LOOKAHEAD_SHRINK_Q8 32   // ...and shrinks slowly, so the length does not pump
+
+// ------------------------- Checksums -------------------------
+// CRC32 (IEEE, reflected), for the settings record and the frame snapshots.
+// Pass the previous result as crc to continue over several buffers.
+inline uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef LIGHTTRACK_RENDER_H
+#define LIGHTTRACK_RENDER_H
+// Render core: the frame renderer and everything it reads. It takes a
+// RenderConstants snapshot and a FrameContext and fills the logical strip,
+// with no I/O, no RTOS calls and no setting globals, so the same code builds
+// into the sketch and into the host tests and benchmarks in test/ (against
+// the CRGB/qadd8 shim in test/host). Included once, by the sketch or a test.
+#include <Arduino.h>
+#include <FastLED.h>
+#include <math.h>
+#include "LightTrackCommon.h"
+
+// ------------------------- Transitions -------------------------
+// Faders run in ledTask; the frame only sees their settings and levels.
+enum TransitionEvent {
+  TRANSITION_BEAM_APPEAR,
+  TRANSITION_BEAM_TIMEOUT,
+  TRANSITION_SCHEDULE,   // lightOn flips (schedule or smart home override)
+  TRANSITION_BACKGROUND,
+  TRANSITION_EVENT_COUNT
+};
+
+struct TransitionSetting {
+  uint16_t durationMs; // 0 = cut
+  uint8_t  curve;      // TransitionCurve
+};
+
+enum TransitionCurve { CURVE_LINEAR, CURVE_EASE_IN, CURVE_EASE_OUT, CURVE_EASE_IN_OUT, CURVE_COUNT };
+
+// ------------------------- Render Constants -------------------------
+// Everything the frame loop derives from settings, computed once per settings
+// change (publishRenderConstants() in the sketch) and read-only per frame.
+#define FADE_MAX_WIDTH 10 // Fade width at gradientSoftness 10
+
+// Ordered thresholds (bit-reversed 0..15, centred) for dithering 8.8 colours
+// down to 8 bits. Indexed by pixel + frame, so neighbouring pixels are out of
+// phase and each pixel cycles through all 16 thresholds.
+const uint8_t ditherLut[16] = { 8, 136, 72, 200, 40, 168, 104, 232, 24, 152, 88, 216, 56, 184, 120, 248 };
+
+struct RenderConstants {
+  uint16_t background16[3]; // baseColor * stationaryIntensity in 8.8 fixed point (R, G, B), colour corrected
+  CRGB beamColor;        // baseColor * movingIntensity (full-bright beam), colour corrected
+  int  centerShift;
+  int  tailOffset;       // LEDs behind the centre, opposite the walking direction
+  int  headOffset;       // LEDs ahead of the centre, including additionalLEDs
+  int  totalLightLength;
+  bool fadeEnabled;
+  uint8_t fadeWidth;     // Pixels faded at each end, at most half the beam
+  uint16_t fadeLut[FADE_MAX_WIDTH]; // Edge factor in 1/256 by distance from the end (0 = unlit)
+  TransitionSetting transitions[TRANSITION_EVENT_COUNT];
+  uint8_t effect;        // Index into effectRegistry[]
+  uint8_t maxBeams;
+  uint16_t lookAheadMs;
+  bool background;       // Background light mode, here so a preset switches it in the same frame
+  uint32_t ledOffDelayMs;
+  int updateInterval;      // Frame period in ms
+  uint16_t powerBudgetMa;
+};
+
+// Beam geometry and edge fade for one set of shape settings. Kept apart from
+// the globals so the frame snapshots can render shapes other than the live one.
+inline void computeBeamShape(RenderConstants& k, int length, int extra, int softness, int shift) {
+  k.centerShift = shift;
+  k.tailOffset = length / 2;
+  k.headOffset = length - 1 + extra - k.tailOffset;
+  k.totalLightLength = max(1, length + extra);
+  k.fadeEnabled = (softness > 0 && k.totalLightLength > 1);
+  k.fadeWidth = constrain(map(softness, 0, 10, 1, FADE_MAX_WIDTH), 1, max(1, k.totalLightLength / 2));
+
+  float fadeExponent = 1.0 + (softness / 10.0) * 2.0;
+  for (int pos = 0; pos < k.fadeWidth; pos++) {
+    float factor = pow((float)(pos + 1) / (k.fadeWidth + 1), fadeExponent);
+    k.fadeLut[pos] = (factor > 0.01f) ? (uint16_t)(factor * 256.0f + 0.5f) : 0;
+  }
+}
+
+// Intensity in 1/256 at pos pixels from the left end of a beam of length
+// pixels (totalLightLength plus any look-ahead); 0 outside the beam
+inline uint16_t beamProfile(const RenderConstants& k, int pos, int length) {
+  if (pos < 0 || pos >= length) return 0;
+  if (!k.fadeEnabled) return 256;
+  if (pos < k.fadeWidth) return k.fadeLut[pos];
+  int fromEnd = length - 1 - pos;
+  if (fromEnd < k.fadeWidth) return k.fadeLut[fromEnd];
+  return 256;
+}
+
+// Scales a colour by level in 1/256 (256 leaves it unchanged)
+inline CRGB scaleColorQ8(CRGB c, uint16_t level) {
+  if (level >= 256) return c;
+  return CRGB((c.r * level) >> 8, (c.g * level) >> 8, (c.b * level) >> 8);
+}
+
+// Load of one pixel in mA/255 units
+inline int32_t pixelLoad(const CRGB& c) {
+  return c.r * LED_MA_RED + c.g * LED_MA_GREEN + c.b * LED_MA_BLUE;
+}
+
+// ------------------------- Render Profiling -------------------------
+// With -DRENDER_PROFILING the sketch times each ledTask stage with the CPU
+// cycle counter (recordStageCycles() is in the sketch). Without it, and on
+// the host, the macros expand to nothing.
+#ifdef RENDER_PROFILING
+enum RenderStage {
+  STAGE_READ_SAMPLE,
+  STAGE_MOVEMENT,
+  STAGE_BACKGROUND,
+  STAGE_LAYERS, // Compositing every layer over the base pass
+  STAGE_EFFECT, // Whole active effect; minus background and layers = dispatch overhead
+  STAGE_MAP,
+  STAGE_SHOW,
+  STAGE_FRAME, // Whole frame, read sample through show
+  STAGE_COUNT
+};
+
+void recordStageCycles(RenderStage stage, uint32_t cycles);
+
+#define PROFILE_BEGIN(stage) uint32_t profileStart_##stage = ESP.getCycleCount()
+#define PROFILE_END(stage)   recordStageCycles(stage, ESP.getCycleCount() - profileStart_##stage)
+#else
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#endif
+
+// ------------------------- Effects -------------------------
+// ledTask hands each frame to the active effect with one virtual call.
+// Effects are stacks of passes: structs with a static render() that
+// LayeredEffect calls directly, so each pass's pixel loop is inlined into
+// the effect. The first pass writes every pixel; the rest are layers that
+// the compositor blends over it. A new effect is a layer (or a new stack)
+// plus an entry in effectRegistry[]; ledTask stays as it is.
+
+struct BeamTarget {
+  unsigned int distance;
+  int direction;            // +1 away from the sensor
+  uint16_t level;           // masterLevel * this beam's fade
+  uint16_t extension;       // Look-ahead LEDs added to the head
+};
+
+// Everything an effect sees for one frame
+struct FrameContext {
+  const RenderConstants* k;
+  CRGB* pixels;             // Logical strip, index 0 nearest the sensor
+  int count;
+  BeamTarget beams[MAX_TARGETS]; // Visible beams only
+  uint8_t beamCount;
+  uint16_t masterLevel;     // Schedule fade, 1/256
+  uint16_t backgroundLevel; // masterLevel * background fade
+  uint8_t frame;            // Dither phase
+  int32_t load;             // Pixel current for the power budget, kept up to date by every pass
+};
+
+class Effect {
+ public:
+  virtual const char* name() const = 0;
+  virtual void render(FrameContext& frame) = 0; // Must write every pixel
+};
+
+template <class... Passes> struct PassList;
+template <> struct PassList<> {
+  static inline void render(FrameContext&) {}
+};
+template <class First, class... Rest> struct PassList<First, Rest...> {
+  static inline void render(FrameContext& frame) {
+    First::render(frame);
+    PassList<Rest...>::render(frame);
+  }
+};
+
+template <class Base, class... Layers>
+class LayeredEffect : public Effect {
+ public:
+  explicit LayeredEffect(const char* effectName) : effectName(effectName) {}
+  const char* name() const { return effectName; }
+  void render(FrameContext& frame) {
+    Base::render(frame);
+    PROFILE_BEGIN(STAGE_LAYERS);
+    PassList<Layers...>::render(frame);
+    PROFILE_END(STAGE_LAYERS);
+  }
+
+ private:
+  const char* effectName;
+};
+
+// Fills the whole strip with the dithered background, or black while the
+// background is off. FollowsToggle = false keeps it lit with the schedule alone.
+template <bool FollowsToggle>
+struct BackgroundPass {
+  static inline void render(FrameContext& f) {
+    PROFILE_BEGIN(STAGE_BACKGROUND);
+    const RenderConstants& k = *f.k;
+    uint16_t level = FollowsToggle ? f.backgroundLevel : f.masterLevel;
+    if (level > 0) {
+      // Temporal dithering: one threshold lookup per pixel, added before dropping to 8 bits
+      uint16_t r16 = (k.background16[0] * level) >> 8;
+      uint16_t g16 = (k.background16[1] * level) >> 8;
+      uint16_t b16 = (k.background16[2] * level) >> 8;
+      for (int i = 0; i < f.count; i++) {
+        uint8_t threshold = ditherLut[(i + f.frame) & 15];
+        f.pixels[i].r = (r16 + threshold) >> 8;
+        f.pixels[i].g = (g16 + threshold) >> 8;
+        f.pixels[i].b = (b16 + threshold) >> 8;
+      }
+      f.load = f.count * (int32_t)((r16 * LED_MA_RED + g16 * LED_MA_GREEN + b16 * LED_MA_BLUE) >> 8);
+    } else {
+      fill_solid(f.pixels, f.count, CRGB::Black);
+      f.load = 0;
+    }
+    PROFILE_END(STAGE_BACKGROUND);
+  }
+};
+
+// ------------------------- Compositor -------------------------
+// A layer claims a span of the strip in begin() and then shades only that
+// span, pixel by pixel in order. LayerPass blends the shaded colour into the
+// frame with a blend mode chosen at compile time, so the blend is inlined
+// into the span loop and pixels outside every span are never touched.
+// A layer type may draw several instances (one per beam); each is its own span.
+struct BlendMax {
+  static inline void apply(CRGB& dst, const CRGB& src, uint8_t) {
+    dst.r = max(dst.r, src.r);
+    dst.g = max(dst.g, src.g);
+    dst.b = max(dst.b, src.b);
+  }
+};
+
+struct BlendAdd { // Additive, saturating at 255
+  static inline void apply(CRGB& dst, const CRGB& src, uint8_t) {
+    dst.r = qadd8(dst.r, src.r);
+    dst.g = qadd8(dst.g, src.g);
+    dst.b = qadd8(dst.b, src.b);
+  }
+};
+
+struct BlendAlpha { // src over dst at the layer's alpha
+  static inline void apply(CRGB& dst, const CRGB& src, uint8_t alpha) {
+    dst.r = blend8(dst.r, src.r, alpha);
+    dst.g = blend8(dst.g, src.g, alpha);
+    dst.b = blend8(dst.b, src.b, alpha);
+  }
+};
+
+template <class Layer, class Blend>
+struct LayerPass {
+  static inline void render(FrameContext& f) {
+    int instances = Layer::count(f);
+    for (int n = 0; n < instances; n++) {
+      Layer layer;
+      int first, last;
+      if (!layer.begin(f, n, first, last)) continue;
+      first = max(first, 0);
+      last = min(last, f.count - 1);
+      uint8_t alpha = layer.alpha;
+      for (int i = first; i <= last; i++) {
+        CRGB& pixel = f.pixels[i];
+        f.load -= pixelLoad(pixel);
+        Blend::apply(pixel, layer.shade(i), alpha);
+        f.load += pixelLoad(pixel);
+      }
+    }
+  }
+};
+
+// One tracking beam per visible target. Black outside the profile, so use it with max or add.
+struct BeamLayer {
+  uint8_t alpha = 255;
+  const RenderConstants* k;
+  CRGB color;
+  int leftLED;       // Pixel holding the beam's left end
+  uint16_t frac;     // How far the beam sits past leftLED, 1/256
+  uint16_t previous; // Profile sample of the pixel before
+  int length;        // totalLightLength plus the look-ahead
+
+  static int count(const FrameContext& f) { return f.beamCount; }
+
+  bool begin(const FrameContext& f, int index, int& first, int& last) {
+    const BeamTarget& beam = f.beams[index]; // Also drawn while fading out, at the last sensed position
+    k = f.k;
+    color = scaleColorQ8(k->beamColor, beam.level);
+
+    // Beam position in 1/256 LED steps, so slow movement glides instead of stepping
+    uint32_t distanceSpan = MAX_DISTANCE - MIN_DISTANCE;
+    uint32_t distanceFromMin = constrain(beam.distance, (unsigned int)MIN_DISTANCE, (unsigned int)MAX_DISTANCE) - MIN_DISTANCE;
+    int32_t positionQ8 = (distanceFromMin * (uint32_t)(f.count - 1) * 256 + distanceSpan / 2) / distanceSpan;
+    int32_t centerQ8 = constrain(positionQ8 + k->centerShift * 256, (int32_t)0, (int32_t)(f.count - 1) * 256);
+
+    // Moving away: tail towards the sensor, head (with additionalLEDs) ahead. Mirrored when moving towards.
+    length = k->totalLightLength + beam.extension;
+    int32_t leftQ8 = centerQ8 - (beam.direction > 0 ? k->tailOffset : k->headOffset + beam.extension) * 256;
+    leftLED = leftQ8 >> 8; // Arithmetic shift: floor, also for negative positions
+    frac = leftQ8 & 0xFF;
+
+    // Pixel leftLED + j covers profile samples j and j - 1 in proportion to frac,
+    // so the two end pixels carry the fractional intensity.
+    first = max(leftLED, 0);
+    last = leftLED + length;
+    previous = beamProfile(*k, first - leftLED - 1, length);
+    return true;
+  }
+
+  inline CRGB shade(int i) {
+    uint16_t current = beamProfile(*k, i - leftLED, length);
+    uint16_t scale = (current * (256 - frac) + previous * frac) >> 8;
+    previous = current;
+    return scaleColorQ8(color, scale);
+  }
+};
+
+// Status overlay: OTA progress as a bar from the sensor end
+volatile int8_t otaProgressPercent = -1; // -1 while no update is running
+
+struct OtaProgressLayer {
+  uint8_t alpha = 160;
+
+  static int count(const FrameContext&) { return 1; }
+
+  bool begin(const FrameContext& f, int, int& first, int& last) {
+    int percent = otaProgressPercent;
+    if (percent < 0) return false;
+    first = 0;
+    last = (f.count * percent) / 100 - 1;
+    return last >= 0;
+  }
+
+  inline CRGB shade(int) { return CRGB(0, 0, 96); }
+};
+
+// Effect registry. Index 0 is the default; EEPROM stores the index.
+LayeredEffect<BackgroundPass<true>, LayerPass<BeamLayer, BlendMax>, LayerPass<OtaProgressLayer, BlendAlpha> >
+    trackingEffect("tracking");     // Beam over the optional background
+LayeredEffect<BackgroundPass<false>, LayerPass<OtaProgressLayer, BlendAlpha> >
+    stationaryEffect("stationary"); // Background only, no beam
+Effect* const effectRegistry[] = { &trackingEffect, &stationaryEffect };
+const uint8_t EFFECT_COUNT = sizeof(effectRegistry) / sizeof(effectRegistry[0]);
+
+inline uint8_t effectCount() { return EFFECT_COUNT; }
+inline const char* effectName(uint8_t index) { return effectRegistry[index]->name(); }
+
+// Builds one frame into f.pixels with the effect chosen in f.k. No I/O and no
+// shared state besides the read-only tables, so it can run on any task.
+inline void renderFrame(FrameContext& f) {
+  effectRegistry[f.k->effect]->render(f);
+}
+
+#endif
@@ -0,0 +1,359 @@
+#ifndef LIGHTTRACK_SETTINGS_H
+#define LIGHTTRACK_SETTINGS_H
+// Persisted settings: the record, its range checks and the one-key-per-field
+// store logic, with no globals and no flash access of their own. The sketch
+// supplies the NVS store and the EEPROM migration; test/settings_test runs
+// the same load and write against a RAM store. Included once, after
+// LightTrackRender.h.
+#include <string.h>
+#include "LightTrackRender.h"
+#include "driver/gpio.h"
+
+// ------------------------- Output Segments -------------------------
+#define MAX_OUTPUT_SEGMENTS 2 // ESP32-C3 has two RMT TX channels
+
+struct OutputSegment {
+  uint8_t  pin;
+  uint16_t start; // First index in leds[]
+  uint16_t count;
+};
+
+// Segments must fit the strip, use distinct output-capable pins and not overlap
+inline bool isValidSegmentLayout(const OutputSegment* segments, uint8_t count) {
+  if (count < 1 || count > MAX_OUTPUT_SEGMENTS) return false;
+  for (int i = 0; i < count; i++) {
+    const OutputSegment& s = segments[i];
+    if (s.count == 0 || s.start + s.count > NUM_LEDS) return false;
+    if (!GPIO_IS_VALID_OUTPUT_GPIO(s.pin) || s.pin == SENSOR_RX_PIN || s.pin == SENSOR_TX_PIN) return false;
+    for (int j = 0; j < i; j++) {
+      const OutputSegment& o = segments[j];
+      if (o.pin == s.pin) return false;
+      if (s.start < o.start + o.count && o.start < s.start + s.count) return false;
+    }
+  }
+  return true;
+}
+
+// ------------------------- Pixel Map -------------------------
+#define MAX_MAP_RUNS 8
+#define MAX_LOGICAL_LEDS (NUM_LEDS * 2) // Installed pixels plus gaps
+#define PIXEL_GAP 0xFFFF
+
+struct PixelRun {
+  uint16_t first; // Physical index of the run's first logical pixel, or PIXEL_GAP
+  uint16_t last;  // Physical index of the run's last logical pixel, or the gap length
+};
+
+inline bool isGapRun(const PixelRun& run) { return run.first == PIXEL_GAP; }
+
+inline int pixelRunLength(const PixelRun& run) {
+  if (isGapRun(run)) return run.last;
+  return abs((int)run.last - (int)run.first) + 1;
+}
+
+// Runs must stay on the strip and may not light a physical LED twice; gaps
+// need a length, and the whole path must fit the logical buffer
+inline bool isValidPixelRuns(const PixelRun* runs, uint8_t count) {
+  if (count < 1 || count > MAX_MAP_RUNS) return false;
+  int logical = 0, installed = 0;
+  for (int i = 0; i < count; i++) {
+    logical += pixelRunLength(runs[i]);
+    if (isGapRun(runs[i])) {
+      if (runs[i].last < 1) return false;
+      continue;
+    }
+    installed++;
+    if (runs[i].first >= NUM_LEDS || runs[i].last >= NUM_LEDS) return false;
+    uint16_t lo = min(runs[i].first, runs[i].last), hi = max(runs[i].first, runs[i].last);
+    for (int j = 0; j < i; j++) {
+      if (isGapRun(runs[j])) continue;
+      uint16_t otherLo = min(runs[j].first, runs[j].last), otherHi = max(runs[j].first, runs[j].last);
+      if (lo <= otherHi && otherLo <= hi) return false;
+    }
+  }
+  return installed > 0 && logical <= MAX_LOGICAL_LEDS;
+}
+
+// ------------------------- Transitions -------------------------
+#define TRANSITION_MAX_MS    10000
+
+inline bool isValidTransitions(const TransitionSetting* settings) {
+  for (int i = 0; i < TRANSITION_EVENT_COUNT; i++) {
+    if (settings[i].durationMs > TRANSITION_MAX_MS || settings[i].curve >= CURVE_COUNT) return false;
+  }
+  return true;
+}
+
+// ------------------------- Settings Record -------------------------
+#define SETTINGS_MAGIC   0x5350544C // "LTPS"
+#define SETTINGS_VERSION 1
+
+struct SettingsHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length; // Bytes of SettingsRecord that follow the header
+  uint32_t crc;    // CRC32 of those bytes
+};
+
+struct SettingsRecord {
+  int updateInterval;
+  int ledOffDelay;
+  float movingIntensity;
+  float stationaryIntensity;
+  int movingLength;
+  int centerShift;
+  int additionalLEDs;
+  CRGB baseColor;
+  int startHour, startMinute, endHour, endMinute;
+  int gradientSoftness;
+  int timezoneOffsetMinutes;
+  bool timezoneSet;
+  uint8_t outputSegmentCount;
+  OutputSegment outputSegments[MAX_OUTPUT_SEGMENTS];
+  uint8_t pixelRunCount;
+  PixelRun pixelRuns[MAX_MAP_RUNS];
+  TransitionSetting transitions[TRANSITION_EVENT_COUNT];
+  uint16_t powerBudgetMa;
+  uint8_t effectIndex;
+  uint8_t maxBeams;
+  uint16_t lookAheadMs;
+  uint8_t colorGammaTenths;
+  uint16_t colorKelvin;
+  CRGB whitePoint;
+};
+
+// Resets every out-of-range field to its default and returns how many it
+// reset. Float checks are written so NaN (erased flash) fails them.
+inline int repairSettings(SettingsRecord& r, const SettingsRecord& d) {
+  int repaired = 0;
+#define REPAIR_IF(bad, field) if (bad) { r.field = d.field; repaired++; }
+  REPAIR_IF(r.updateInterval < 10 || r.updateInterval > 200, updateInterval);
+  REPAIR_IF(r.ledOffDelay < 1 || r.ledOffDelay > 60, ledOffDelay);
+  REPAIR_IF(!(r.movingIntensity >= 0.0f && r.movingIntensity <= 1.0f), movingIntensity);
+  REPAIR_IF(!(r.stationaryIntensity >= 0.0f && r.stationaryIntensity <= 0.1f), stationaryIntensity); // Max 10%
+  REPAIR_IF(r.movingLength < 1 || r.movingLength > NUM_LEDS, movingLength);
+  REPAIR_IF(abs(r.centerShift) > NUM_LEDS / 2, centerShift);
+  REPAIR_IF(r.additionalLEDs < 0 || r.additionalLEDs > NUM_LEDS / 2, additionalLEDs);
+  REPAIR_IF(r.startHour < 0 || r.startHour > 23, startHour);
+  REPAIR_IF(r.startMinute < 0 || r.startMinute > 59, startMinute);
+  REPAIR_IF(r.endHour < 0 || r.endHour > 23, endHour);
+  REPAIR_IF(r.endMinute < 0 || r.endMinute > 59, endMinute);
+  REPAIR_IF(r.gradientSoftness < 0 || r.gradientSoftness > 10, gradientSoftness);
+  if (r.timezoneOffsetMinutes < -720 || r.timezoneOffsetMinutes > 840) {
+    r.timezoneOffsetMinutes = 0;
+    r.timezoneSet = false;
+    repaired++;
+  }
+  if (!isValidSegmentLayout(r.outputSegments, r.outputSegmentCount)) {
+    memcpy(r.outputSegments, d.outputSegments, sizeof(r.outputSegments));
+    r.outputSegmentCount = d.outputSegmentCount;
+    repaired++;
+  }
+  if (!isValidPixelRuns(r.pixelRuns, r.pixelRunCount)) {
+    memcpy(r.pixelRuns, d.pixelRuns, sizeof(r.pixelRuns));
+    r.pixelRunCount = d.pixelRunCount;
+    repaired++;
+  }
+  if (!isValidTransitions(r.transitions)) {
+    memcpy(r.transitions, d.transitions, sizeof(r.transitions));
+    repaired++;
+  }
+  REPAIR_IF(r.powerBudgetMa != 0 && (r.powerBudgetMa < POWER_BUDGET_MIN_MA || r.powerBudgetMa > POWER_BUDGET_MAX_MA), powerBudgetMa);
+  REPAIR_IF(r.effectIndex >= effectCount(), effectIndex);
+  REPAIR_IF(r.maxBeams < 1 || r.maxBeams > MAX_TARGETS, maxBeams);
+  REPAIR_IF(r.lookAheadMs > LOOKAHEAD_MAX_MS, lookAheadMs);
+  REPAIR_IF(r.colorGammaTenths < 10 || r.colorGammaTenths > 30, colorGammaTenths);
+  REPAIR_IF(r.colorKelvin < KELVIN_MIN || r.colorKelvin > KELVIN_MAX, colorKelvin);
+  // Any white point but black is valid (black gains would blank every colour);
+  // erased flash reads 255,255,255, the neutral one
+  REPAIR_IF(r.whitePoint.r == 0 && r.whitePoint.g == 0 && r.whitePoint.b == 0, whitePoint);
+#undef REPAIR_IF
+  return repaired;
+}
+
+// ------------------------- Settings Store -------------------------
+// Settings are kept one key per field in a key-value store, so changing the
+// colour rewrites the three bytes of baseColor rather than every setting.
+// writeSettingsRecord() compares against the last stored copy and writes only
+// the keys that differ. Values are the fields' raw bytes. A key missing from
+// the store keeps its default, so new fields need no migration;
+// SETTINGS_VERSION (the "version" key) changes only for incompatible ones.
+//
+// A single key is written whole or not at all, but a change to several keys
+// is not: power lost partway through leaves some new and some old. Normal
+// edits touch one field at a time, so that is fine; an import, which changes
+// many together, goes through writeSettingsJournaled() instead.
+#define SETTINGS_JOURNAL_KEY "import" // The whole record, while an import is being stored
+class SettingsStore {
+ public:
+  virtual bool begin() = 0;
+  virtual bool read(const char* key, void* value, size_t size) = 0; // False if missing or another size
+  virtual bool write(const char* key, const void* value, size_t size) = 0;
+  virtual bool remove(const char* key) = 0; // True if the key is gone, including when it never existed
+};
+
+struct SettingsField {
+  const char* key; // NVS keys are at most 15 characters
+  uint8_t offset;  // In SettingsRecord
+  uint8_t size;
+};
+#define SETTINGS_FIELD(key, member) { key, offsetof(SettingsRecord, member), sizeof(((SettingsRecord*)0)->member) }
+const SettingsField settingsFields[] = {
+  SETTINGS_FIELD("interval", updateInterval),
+  SETTINGS_FIELD("offDelay", ledOffDelay),
+  SETTINGS_FIELD("movingInt", movingIntensity),
+  SETTINGS_FIELD("stationaryInt", stationaryIntensity),
+  SETTINGS_FIELD("movingLength", movingLength),
+  SETTINGS_FIELD("centerShift", centerShift),
+  SETTINGS_FIELD("addLeds", additionalLEDs),
+  SETTINGS_FIELD("baseColor", baseColor),
+  SETTINGS_FIELD("startHour", startHour),
+  SETTINGS_FIELD("startMinute", startMinute),
+  SETTINGS_FIELD("endHour", endHour),
+  SETTINGS_FIELD("endMinute", endMinute),
+  SETTINGS_FIELD("softness", gradientSoftness),
+  SETTINGS_FIELD("tzOffset", timezoneOffsetMinutes),
+  SETTINGS_FIELD("tzSet", timezoneSet),
+  SETTINGS_FIELD("segmentCount", outputSegmentCount),
+  SETTINGS_FIELD("segments", outputSegments),
+  SETTINGS_FIELD("runCount", pixelRunCount),
+  SETTINGS_FIELD("pixelRuns", pixelRuns),
+  SETTINGS_FIELD("transitions", transitions),
+  SETTINGS_FIELD("powerBudget", powerBudgetMa),
+  SETTINGS_FIELD("effect", effectIndex),
+  SETTINGS_FIELD("maxBeams", maxBeams),
+  SETTINGS_FIELD("lookAhead", lookAheadMs),
+  SETTINGS_FIELD("gamma", colorGammaTenths),
+  SETTINGS_FIELD("kelvin", colorKelvin),
+  SETTINGS_FIELD("whitePoint", whitePoint),
+};
+const uint8_t SETTINGS_FIELD_COUNT = sizeof(settingsFields) / sizeof(settingsFields[0]);
+
+struct SettingsStats {
+  uint32_t saves;     // saveSettings() calls
+  uint32_t flushes;   // writeSettings() runs
+  uint32_t keyWrites; // Keys actually written to flash
+  uint32_t bytes;     // Value bytes in those keys
+};
+
+// The store's side of the settings, kept between loads and writes
+struct SettingsState {
+  SettingsRecord stored; // What the store holds, as of the last read or write
+  bool storedValid;      // False until the store holds every key
+  bool journaled;        // SETTINGS_JOURNAL_KEY is in the store
+  bool readOnly;         // The store is a newer firmware's: run from RAM and write nothing
+  SettingsStats stats;
+};
+
+struct SettingsWrite {
+  int keys;
+  unsigned bytes;
+  bool ok;
+};
+
+// Writes the fields of r that differ from the stored copy, or every field
+// and then the "version" key while the store is incomplete. Version goes
+// last, so a first write cut short by power loss leaves no version and the
+// next boot redoes the migration instead of mixing old keys with defaults.
+inline SettingsWrite writeSettingsRecord(SettingsStore& store, SettingsState& state, const SettingsRecord& r) {
+  SettingsWrite w = { 0, 0, !state.readOnly };
+  if (state.readOnly) return w;
+  for (int i = 0; i < SETTINGS_FIELD_COUNT; i++) {
+    const SettingsField& f = settingsFields[i];
+    const uint8_t* value = (const uint8_t*)&r + f.offset;
+    if (state.storedValid && memcmp(value, (const uint8_t*)&state.stored + f.offset, f.size) == 0) continue;
+    w.ok = store.write(f.key, value, f.size) && w.ok;
+    w.keys++;
+    w.bytes += f.size;
+  }
+  if (!state.storedValid) {
+    uint8_t version = SETTINGS_VERSION;
+    w.ok = store.write("version", &version, sizeof(version)) && w.ok;
+  }
+  if (w.ok) {
+    state.stored = r;
+    state.storedValid = true;
+  }
+  if (w.ok && state.journaled) { // The keys now hold everything the journal did
+    state.journaled = !store.remove(SETTINGS_JOURNAL_KEY);
+    w.ok = !state.journaled;
+  }
+  state.stats.keyWrites += w.keys;
+  state.stats.bytes += w.bytes;
+  return w;
+}
+
+// Writes r all-or-nothing: after a power loss at any point the next boot
+// loads either the settings from before or all of r, never a mix. The whole
+// record goes under SETTINGS_JOURNAL_KEY first, in one key write; then the
+// changed field keys; then the journal is removed. A boot that finds the
+// journal loads it in place of the field keys and finishes the write. Costs
+// one record-sized write more than writeSettingsRecord().
+inline SettingsWrite writeSettingsJournaled(SettingsStore& store, SettingsState& state, const SettingsRecord& r) {
+  if (state.readOnly || !store.write(SETTINGS_JOURNAL_KEY, &r, sizeof(r))) {
+    SettingsWrite failed = { 0, 0, false }; // Nothing changed
+    return failed;
+  }
+  state.journaled = true;
+  state.stats.keyWrites++;
+  state.stats.bytes += sizeof(r);
+  SettingsWrite w = writeSettingsRecord(store, state, r);
+  w.keys++;
+  w.bytes += sizeof(r);
+  return w;
+}
+
+// Fills r from wherever the settings were before this store (EEPROM in the
+// sketch) and says where that was
+typedef const char* (*SettingsMigration)(SettingsRecord& r);
+
+struct SettingsLoad {
+  const char* source;
+  bool opened;         // store.begin() succeeded
+  int repaired;        // Fields reset to their defaults
+  bool written;        // Stored back: first boot with the store, a pending journal or repaired fields
+  SettingsWrite write;
+};
+
+// Boot load into r, which starts as a copy of defaults. A journal left by an
+// interrupted writeSettingsJournaled() wins over the field keys. A store
+// without the "version" key has never been written completely, so migrate()
+// fills r instead. An unknown version is a newer firmware's store, after a
+// downgrade: r keeps the defaults and the state turns read-only, so going
+// back to that firmware finds its settings intact. Otherwise the result is
+// range checked against the defaults and written back when the store is
+// incomplete, a journal is pending or a field was repaired.
+inline SettingsLoad loadSettingsRecord(SettingsStore& store, SettingsState& state, const SettingsRecord& defaults,
+                                       SettingsMigration migrate, SettingsRecord& r) {
+  SettingsLoad load;
+  load.source = "NVS";
+  r = defaults;
+
+  uint8_t version = 0;
+  load.opened = store.begin();
+  bool hasVersion = load.opened && store.read("version", &version, sizeof(version));
+  if (hasVersion && version != SETTINGS_VERSION) {
+    load.source = "defaults (unknown NVS version, not saved)";
+    state.readOnly = true;
+  } else if (load.opened && store.read(SETTINGS_JOURNAL_KEY, &r, sizeof(r))) {
+    load.source = "NVS (finishing an interrupted import)";
+    state.journaled = true; // stored stays invalid, so every key is rewritten
+  } else if (hasVersion) {
+    for (int i = 0; i < SETTINGS_FIELD_COUNT; i++) {
+      const SettingsField& f = settingsFields[i];
+      store.read(f.key, (uint8_t*)&r + f.offset, f.size); // A missing key keeps its default
+    }
+    state.stored = r;
+    state.storedValid = true;
+  } else {
+    load.source = migrate(r);
+  }
+
+  load.repaired = repairSettings(r, defaults);
+  load.written = !state.readOnly && (!state.storedValid || state.journaled || load.repaired > 0);
+  SettingsWrite none = { 0, 0, true };
+  load.write = load.written ? writeSettingsRecord(store, state, r) : none;
+  return load;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef LIGHTTRACK_SNAPSHOTS_H
+#define LIGHTTRACK_SNAPSHOTS_H
+// Frame snapshots: the tracking effect rendered for every combination of the
+// axes below into a scratch strip, one CRC32 per frame. Colours are fixed
+// test values rather than the configured ones, so a CRC only changes when
+// the frame math does. test/snapshot_test renders the cases on the host and
+// checks them against test/golden/snapshots.csv; a -DRENDER_SNAPSHOTS build
+// serves the same cases at /snapshots.
+//
+// Clock is a struct with static uint32_t ticks() and float ticksPerUs():
+// the CPU cycle counter on the device, a steady clock on the host.
+#include <stdio.h>
+#include "LightTrackRender.h"
+
+#define SNAPSHOT_LEDS    120
+#define SNAPSHOT_REPEATS 8
+const int snapshotLengths[] = { 1, 6, 30 };        // movingLength
+const int snapshotExtras[] = { 0, 10 };            // additionalLEDs
+const int snapshotSoftness[] = { 0, 5, 10 };       // gradientSoftness
+const int snapshotShifts[] = { -15, 0, 15 };       // centerShift, past both strip ends from the end distances
+const int snapshotDirections[] = { 1, -1 };
+const bool snapshotBackgrounds[] = { false, true };
+const unsigned int snapshotDistances[] = { MIN_DISTANCE, (MIN_DISTANCE + MAX_DISTANCE) / 2, MAX_DISTANCE };
+#define SNAPSHOT_AXIS(a) (sizeof(a) / sizeof(a[0]))
+#define SNAPSHOT_CASES (SNAPSHOT_AXIS(snapshotLengths) * SNAPSHOT_AXIS(snapshotExtras) * \
+                        SNAPSHOT_AXIS(snapshotSoftness) * SNAPSHOT_AXIS(snapshotShifts) * \
+                        SNAPSHOT_AXIS(snapshotDirections) * SNAPSHOT_AXIS(snapshotBackgrounds) * \
+                        SNAPSHOT_AXIS(snapshotDistances))
+
+#define SNAPSHOT_CSV_HEADER "movingLength,additionalLEDs,gradientSoftness,centerShift,direction,background,distance,crc32,us\n"
+
+struct SnapshotCase {
+  int length;
+  int extra;
+  int softness;
+  int shift;
+  int direction;
+  bool background;
+  unsigned int distance;
+};
+
+// Case index to settings, in CSV order: distance varies fastest, length slowest
+inline SnapshotCase snapshotCase(size_t index) {
+  SnapshotCase c;
+  c.distance = snapshotDistances[index % SNAPSHOT_AXIS(snapshotDistances)]; index /= SNAPSHOT_AXIS(snapshotDistances);
+  c.background = snapshotBackgrounds[index % SNAPSHOT_AXIS(snapshotBackgrounds)]; index /= SNAPSHOT_AXIS(snapshotBackgrounds);
+  c.direction = snapshotDirections[index % SNAPSHOT_AXIS(snapshotDirections)]; index /= SNAPSHOT_AXIS(snapshotDirections);
+  c.shift = snapshotShifts[index % SNAPSHOT_AXIS(snapshotShifts)]; index /= SNAPSHOT_AXIS(snapshotShifts);
+  c.softness = snapshotSoftness[index % SNAPSHOT_AXIS(snapshotSoftness)]; index /= SNAPSHOT_AXIS(snapshotSoftness);
+  c.extra = snapshotExtras[index % SNAPSHOT_AXIS(snapshotExtras)]; index /= SNAPSHOT_AXIS(snapshotExtras);
+  c.length = snapshotLengths[index];
+  return c;
+}
+
+// Fixed colours and one full-level beam over pixels[SNAPSHOT_LEDS]
+inline void beginSnapshots(RenderConstants& k, FrameContext& f, CRGB* pixels) {
+  memset((void*)&k, 0, sizeof(k));
+  k.background16[0] = 0x2000; k.background16[1] = 0x1000; k.background16[2] = 0x0800;
+  k.beamColor = CRGB(255, 128, 64);
+  k.effect = 0; // Tracking
+
+  f.k = &k;
+  f.pixels = pixels;
+  f.count = SNAPSHOT_LEDS;
+  f.beamCount = 1;
+  f.masterLevel = 256;
+  f.frame = 0;
+  f.beams[0].level = 256;
+  f.beams[0].extension = 0;
+}
+
+// Renders case c SNAPSHOT_REPEATS times; returns the frame's CRC32 and sets
+// us to the average render time
+template <class Clock>
+uint32_t renderSnapshot(const SnapshotCase& c, RenderConstants& k, FrameContext& f, float& us) {
+  computeBeamShape(k, c.length, c.extra, c.softness, c.shift);
+  f.beams[0].direction = c.direction;
+  f.beams[0].distance = c.distance;
+  f.backgroundLevel = c.background ? 256 : 0;
+
+  uint32_t start = Clock::ticks();
+  for (int r = 0; r < SNAPSHOT_REPEATS; r++) {
+    f.load = 0;
+    renderFrame(f);
+  }
+  uint32_t ticks = Clock::ticks() - start;
+  us = ticks / Clock::ticksPerUs() / SNAPSHOT_REPEATS;
+  return crc32Update(0, (const uint8_t*)f.pixels, f.count * sizeof(CRGB));
+}
+
+// One CSV line; the digest over all cases chains each case's CRC
+inline int formatSnapshotLine(char* line, size_t size, const SnapshotCase& c, uint32_t crc, float us) {
+  return snprintf(line, size, "%d,%d,%d,%d,%d,%d,%u,%08x,%.2f\n", c.length, c.extra, c.softness, c.shift,
+                  c.direction, c.background ? 1 : 0, c.distance, (unsigned)crc, us);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+// Host stand-in for the parts of Arduino-ESP32 the render core uses, with
+// the same definitions as the core so results match the device.
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  const long run = in_max - in_min;
+  if (run == 0) return -1;
+  const long rise = out_max - out_min;
+  const long delta = x - in_min;
+  return (delta * rise) / run + out_min;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HOST_FASTLED_H
+#define HOST_FASTLED_H
+// Host stand-in for the FastLED pieces the render core uses: CRGB and the
+// lib8tion helpers, with FastLED's own arithmetic.
+#include <stdint.h>
+
+struct CRGB {
+  union {
+    struct {
+      uint8_t r;
+      uint8_t g;
+      uint8_t b;
+    };
+    uint8_t raw[3];
+  };
+
+  enum HTMLColorCode { Black = 0x000000 };
+
+  CRGB() {}
+  CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+  CRGB(HTMLColorCode code) : r((code >> 16) & 0xFF), g((code >> 8) & 0xFF), b(code & 0xFF) {}
+};
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+  unsigned int t = i + j;
+  return t > 255 ? 255 : t;
+}
+
+inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+  uint16_t partial = (a << 8) | b;
+  partial += (b * amountOfB);
+  partial -= (a * amountOfB);
+  return partial >> 8;
+}
+
+inline void fill_solid(CRGB* leds, int numToFill, const CRGB& color) {
+  for (int i = 0; i < numToFill; i++) leds[i] = color;
+}
+
+#endif
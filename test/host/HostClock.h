@@ -0,0 +1,17 @@
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+// Clock for the shared snapshot and benchmark code: nanoseconds from a
+// steady clock, wrapping like the device's cycle counter.
+#include <stdint.h>
+#include <chrono>
+
+struct HostClock {
+  static uint32_t ticks() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  static float ticksPerUs() { return 1000.0f; }
+  static uint32_t floatCalls() { return 0; } // The host has an FPU; soft-float calls are counted on the device
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef RAM_SETTINGS_STORE_H
+#define RAM_SETTINGS_STORE_H
+// SettingsStore in RAM for the host tests. Like NVS, each write replaces one
+// key whole. Counts writes, and can lose power after a given number of them:
+// that write and every later one fail without touching the contents.
+#include <map>
+#include <string>
+#include <vector>
+#include "LightTrackSettings.h"
+
+class RamSettingsStore : public SettingsStore {
+ public:
+  std::map<std::string, std::vector<uint8_t> > keys;
+  bool available = true; // begin() result
+  int writes = 0;        // Successful writes
+  int writesLeft = -1;   // Before power is lost; -1 = never
+
+  bool begin() { return available; }
+
+  bool read(const char* key, void* value, size_t size) {
+    std::map<std::string, std::vector<uint8_t> >::const_iterator it = keys.find(key);
+    if (it == keys.end() || it->second.size() != size) return false;
+    memcpy(value, &it->second[0], size);
+    return true;
+  }
+
+  bool write(const char* key, const void* value, size_t size) {
+    if (writesLeft == 0) return false;
+    if (writesLeft > 0) writesLeft--;
+    const uint8_t* bytes = (const uint8_t*)value;
+    keys[key].assign(bytes, bytes + size);
+    writes++;
+    return true;
+  }
+
+  bool remove(const char* key) {
+    if (writesLeft == 0) return false;
+    keys.erase(key);
+    return true;
+  }
+
+  bool has(const char* key) const { return keys.count(key) > 0; }
+};
+
+#endif
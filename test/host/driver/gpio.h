@@ -0,0 +1,6 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+// ESP32-C3 pin check, as in ESP-IDF's driver/gpio.h: GPIO0..21 can all drive an output
+#define GPIO_IS_VALID_OUTPUT_GPIO(gpio_num) ((gpio_num) >= 0 && (gpio_num) <= 21)
+
+#endif
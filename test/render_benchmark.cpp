@@ -0,0 +1,20 @@
+// Runs the render benchmark sweep from LightTrackBenchmark.h on the host,
+// with the sketch's render core, and writes its CSV to stdout: the same
+// passes, strip lengths (60 to 2000 LEDs) and columns as /benchmark on the
+// device. softFloatCalls is always 0 here.
+#include "LightTrackBenchmark.h"
+#include "HostClock.h"
+
+CRGB benchmarkLeds[BENCHMARK_MAX_LEDS];
+
+struct StdoutOut {
+  void row(const char* line) { fputs(line, stdout); }
+  void flush() { fflush(stdout); }
+};
+
+int main() {
+  printf("%s", BENCHMARK_CSV_HEADER);
+  StdoutOut out;
+  runRenderBenchmark<HostClock>(benchmarkLeds, out);
+  return 0;
+}
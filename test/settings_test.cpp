@@ -0,0 +1,306 @@
+// Runs the sketch's settings load and write (LightTrackSettings.h) against a
+// RAM store: first boot migration, range repair, changed-key writes, missing
+// keys, a first write cut short by power loss and an import cut short at
+// every step. Then times a write.
+//   settings_test
+#include <stdio.h>
+#include "RamSettingsStore.h"
+#include "HostClock.h"
+
+int checks = 0, failures = 0;
+#define CHECK(cond) do { checks++; if (!(cond)) { \
+  fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// The sketch's initial globals
+SettingsRecord defaultSettings() {
+  SettingsRecord r;
+  memset((void*)&r, 0, sizeof(r));
+  r.updateInterval = 20;
+  r.ledOffDelay = 5;
+  r.movingIntensity = 0.3f;
+  r.stationaryIntensity = 0.03f;
+  r.movingLength = 33;
+  r.baseColor = CRGB(255, 200, 50);
+  r.startHour = 20; r.endHour = 8; r.endMinute = 30;
+  r.gradientSoftness = 7;
+  r.outputSegmentCount = 1;
+  r.outputSegments[0].pin = LED_PIN; r.outputSegments[0].count = NUM_LEDS;
+  r.pixelRunCount = 1;
+  r.pixelRuns[0].last = NUM_LEDS - 1;
+  r.powerBudgetMa = 4000;
+  r.maxBeams = 1;
+  r.colorGammaTenths = 10;
+  r.colorKelvin = 6500;
+  r.whitePoint = CRGB(255, 255, 255);
+  return r;
+}
+
+// Stands in for the EEPROM: what migrate() hands over, and how often it was asked
+SettingsRecord eepromSettings;
+int migrations = 0;
+
+const char* migrateFromEeprom(SettingsRecord& r) {
+  migrations++;
+  r = eepromSettings;
+  return "moved from the EEPROM record";
+}
+
+bool sameSettings(const SettingsRecord& a, const SettingsRecord& b) { return memcmp(&a, &b, sizeof(a)) == 0; }
+
+// One boot: a fresh SettingsState over whatever the store holds
+SettingsLoad boot(RamSettingsStore& store, SettingsState& state, SettingsRecord& r) {
+  state = SettingsState();
+  return loadSettingsRecord(store, state, defaultSettings(), migrateFromEeprom, r);
+}
+
+void testFirstBootMigrates() {
+  RamSettingsStore store;
+  SettingsState state;
+  SettingsRecord r;
+  eepromSettings = defaultSettings();
+  eepromSettings.movingLength = 50;
+  eepromSettings.gradientSoftness = 99; // Out of range in the old flash
+  migrations = 0;
+
+  SettingsLoad load = boot(store, state, r);
+  CHECK(migrations == 1);
+  CHECK(strcmp(load.source, "moved from the EEPROM record") == 0);
+  CHECK(r.movingLength == 50);
+  CHECK(load.repaired == 1 && r.gradientSoftness == 7);
+  CHECK(load.written && load.write.ok && load.write.keys == SETTINGS_FIELD_COUNT);
+  CHECK(store.writes == SETTINGS_FIELD_COUNT + 1 && store.has("version"));
+  CHECK(state.storedValid && sameSettings(state.stored, r));
+
+  // Second boot reads the store back and writes nothing
+  store.writes = 0;
+  SettingsRecord again;
+  load = boot(store, state, again);
+  CHECK(migrations == 1);
+  CHECK(strcmp(load.source, "NVS") == 0);
+  CHECK(sameSettings(again, r));
+  CHECK(!load.written && store.writes == 0);
+}
+
+void testWritesOnlyChangedKeys() {
+  RamSettingsStore store;
+  SettingsState state;
+  SettingsRecord r;
+  eepromSettings = defaultSettings();
+  boot(store, state, r);
+
+  store.writes = 0;
+  SettingsWrite w = writeSettingsRecord(store, state, r);
+  CHECK(w.ok && w.keys == 0 && store.writes == 0);
+
+  r.baseColor = CRGB(0, 0, 255);
+  w = writeSettingsRecord(store, state, r);
+  CHECK(w.ok && w.keys == 1 && w.bytes == sizeof(CRGB) && store.writes == 1);
+  CHECK(state.stats.keyWrites == SETTINGS_FIELD_COUNT + 1); // The first write's fields, then this one
+
+  SettingsRecord loaded;
+  boot(store, state, loaded);
+  CHECK(loaded.baseColor.r == 0 && loaded.baseColor.g == 0 && loaded.baseColor.b == 255);
+}
+
+void testMissingKeyKeepsDefault() {
+  RamSettingsStore store;
+  SettingsState state;
+  SettingsRecord r;
+  eepromSettings = defaultSettings();
+  eepromSettings.maxBeams = 3;
+  eepromSettings.lookAheadMs = 200;
+  boot(store, state, r);
+  CHECK(r.maxBeams == 3);
+
+  store.remove("maxBeams"); // As firmware from before the field left it
+  store.writes = 0;
+  SettingsLoad load = boot(store, state, r);
+  CHECK(strcmp(load.source, "NVS") == 0);
+  CHECK(r.maxBeams == 1 && r.lookAheadMs == 200);
+  CHECK(!load.written && store.writes == 0);
+
+  // A key of the wrong size reads as missing too
+  uint16_t wide = 3;
+  store.write("maxBeams", &wide, sizeof(wide));
+  boot(store, state, r);
+  CHECK(r.maxBeams == 1);
+}
+
+void testRepairsStoredValues() {
+  RamSettingsStore store;
+  SettingsState state;
+  SettingsRecord r;
+  eepromSettings = defaultSettings();
+  boot(store, state, r);
+
+  int interval = 5000;
+  uint8_t effect = 200;
+  store.write("interval", &interval, sizeof(interval));
+  store.write("effect", &effect, sizeof(effect));
+  store.writes = 0;
+  SettingsLoad load = boot(store, state, r);
+  CHECK(load.repaired == 2 && r.updateInterval == 20 && r.effectIndex == 0);
+  CHECK(load.written && load.write.keys == 2 && store.writes == 2);
+
+  load = boot(store, state, r);
+  CHECK(load.repaired == 0 && !load.written);
+
+  // Black gains would blank every colour
+  CRGB black(0, 0, 0);
+  store.write("whitePoint", &black, sizeof(black));
+  load = boot(store, state, r);
+  CHECK(load.repaired == 1 && r.whitePoint.r == 255 && r.whitePoint.g == 255 && r.whitePoint.b == 255);
+}
+
+void testInterruptedFirstWrite() {
+  RamSettingsStore store;
+  SettingsState state;
+  SettingsRecord r;
+  eepromSettings = defaultSettings();
+  eepromSettings.movingLength = 50;
+  eepromSettings.colorKelvin = 3000;
+  migrations = 0;
+
+  store.writesLeft = 10; // Power fails partway through the first write
+  SettingsLoad load = boot(store, state, r);
+  CHECK(!load.write.ok && !state.storedValid);
+  CHECK(store.keys.size() == 10 && !store.has("version"));
+
+  // Next boot finds no version, so it migrates again rather than trusting
+  // ten keys and defaulting the rest
+  store.writesLeft = -1;
+  load = boot(store, state, r);
+  CHECK(migrations == 2);
+  CHECK(strcmp(load.source, "moved from the EEPROM record") == 0);
+  CHECK(r.movingLength == 50 && r.colorKelvin == 3000);
+  CHECK(load.write.ok && store.has("version") && store.keys.size() == SETTINGS_FIELD_COUNT + 1u);
+
+  load = boot(store, state, r);
+  CHECK(migrations == 2 && strcmp(load.source, "NVS") == 0 && r.colorKelvin == 3000);
+}
+
+void testUnknownVersionAndNoStore() {
+  RamSettingsStore store;
+  SettingsState state;
+  SettingsRecord r;
+  eepromSettings = defaultSettings();
+  eepromSettings.movingLength = 50;
+  uint8_t version = SETTINGS_VERSION + 1;
+  store.write("version", &version, sizeof(version));
+  migrations = 0;
+
+  store.writes = 0;
+  SettingsLoad load = boot(store, state, r);
+  CHECK(strcmp(load.source, "defaults (unknown NVS version, not saved)") == 0);
+  CHECK(migrations == 0 && sameSettings(r, defaultSettings()));
+  CHECK(!load.written && store.writes == 0);
+
+  // Edits and imports run from RAM too, leaving the newer firmware's keys alone
+  r.movingLength = 40;
+  CHECK(!writeSettingsRecord(store, state, r).ok && !writeSettingsJournaled(store, state, r).ok);
+  CHECK(store.writes == 0 && store.keys.size() == 1);
+
+  RamSettingsStore closed;
+  closed.available = false;
+  load = boot(closed, state, r);
+  CHECK(!load.opened && migrations == 1 && r.movingLength == 50);
+}
+
+// An import changes several keys at once; wherever power fails, the next
+// boot must load all of it or none of it
+void testImportIsAllOrNothing() {
+  SettingsRecord before = defaultSettings();
+  SettingsRecord imported = before;
+  imported.movingLength = 50;
+  imported.baseColor = CRGB(0, 0, 255);
+  imported.gradientSoftness = 3;
+  imported.maxBeams = 2;
+  imported.colorKelvin = 3000;
+  const int changed = 5;
+  eepromSettings = before;
+
+  {
+    RamSettingsStore store;
+    SettingsState state;
+    SettingsRecord r;
+    boot(store, state, r);
+    store.writes = 0;
+    SettingsWrite w = writeSettingsJournaled(store, state, imported);
+    CHECK(w.ok && w.keys == changed + 1 && store.writes == changed + 1);
+    CHECK(!store.has(SETTINGS_JOURNAL_KEY) && !state.journaled);
+  }
+
+  // Journal, the changed keys, then the journal's removal
+  for (int cut = 0; cut <= changed + 1; cut++) {
+    RamSettingsStore store;
+    SettingsState state;
+    SettingsRecord r;
+    boot(store, state, r);
+    store.writesLeft = cut;
+    SettingsWrite w = writeSettingsJournaled(store, state, imported);
+    CHECK(!w.ok);
+    store.writesLeft = -1;
+
+    SettingsLoad load = boot(store, state, r);
+    CHECK(sameSettings(r, cut == 0 ? before : imported));
+    CHECK(load.write.ok && !store.has(SETTINGS_JOURNAL_KEY));
+    CHECK(cut == 0 ? strcmp(load.source, "NVS") == 0 : strcmp(load.source, "NVS (finishing an interrupted import)") == 0);
+    load = boot(store, state, r);
+    CHECK(sameSettings(r, cut == 0 ? before : imported) && !load.written);
+  }
+
+  // A later ordinary write finishes a journal the import left behind
+  RamSettingsStore store;
+  SettingsState state;
+  SettingsRecord r;
+  boot(store, state, r);
+  store.writesLeft = 3;
+  writeSettingsJournaled(store, state, imported);
+  store.writesLeft = -1;
+  SettingsRecord edited = imported;
+  edited.ledOffDelay = 9;
+  CHECK(writeSettingsRecord(store, state, edited).ok && !store.has(SETTINGS_JOURNAL_KEY));
+  boot(store, state, r);
+  CHECK(sameSettings(r, edited));
+}
+
+// ns per writeSettingsRecord() call, store included
+template <class Change>
+void timeWrites(const char* name, Change change) {
+  const int repeats = 20000;
+  RamSettingsStore store;
+  SettingsState state;
+  SettingsRecord r;
+  eepromSettings = defaultSettings();
+  boot(store, state, r);
+  int keys = 0;
+  uint32_t start = HostClock::ticks();
+  for (int i = 0; i < repeats; i++) {
+    change(state, r, i);
+    keys += writeSettingsRecord(store, state, r).keys;
+  }
+  float ns = (float)(HostClock::ticks() - start) * 1000.0f / HostClock::ticksPerUs() / repeats;
+  printf("%s,%.1f,%.1f\n", name, (float)keys / repeats, ns);
+}
+
+void noChange(SettingsState&, SettingsRecord&, int) {}
+void colorChange(SettingsState&, SettingsRecord& r, int i) { r.baseColor = CRGB(i, i >> 8, 0); }
+void firstWrite(SettingsState& state, SettingsRecord&, int) { state.storedValid = false; }
+
+int main() {
+  testFirstBootMigrates();
+  testWritesOnlyChangedKeys();
+  testMissingKeyKeepsDefault();
+  testRepairsStoredValues();
+  testInterruptedFirstWrite();
+  testUnknownVersionAndNoStore();
+  testImportIsAllOrNothing();
+
+  printf("write,keysPerWrite,nsPerWrite\n");
+  timeWrites("unchanged", noChange);
+  timeWrites("oneKey", colorChange);
+  timeWrites("allKeys", firstWrite);
+
+  fprintf(stderr, "%d checks, %d failed\n", checks, failures);
+  return failures == 0 ? 0 : 1;
+}
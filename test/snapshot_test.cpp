@@ -0,0 +1,95 @@
+// Renders every case in LightTrackSnapshots.h with the sketch's render core
+// and checks each frame's CRC32 against the golden file. Prints the CSV with
+// the time per case and fails on any mismatch.
+//   snapshot_test golden/snapshots.csv            check
+//   snapshot_test --update golden/snapshots.csv   rewrite after an intended change
+#include <string>
+#include <vector>
+#include "LightTrackSnapshots.h"
+#include "HostClock.h"
+
+CRGB snapshotLeds[SNAPSHOT_LEDS];
+
+// The golden file holds the CSV without the timing column
+std::string goldenLine(const SnapshotCase& c, uint32_t crc) {
+  char line[96];
+  snprintf(line, sizeof(line), "%d,%d,%d,%d,%d,%d,%u,%08x", c.length, c.extra, c.softness, c.shift,
+           c.direction, c.background ? 1 : 0, c.distance, (unsigned)crc);
+  return line;
+}
+
+bool readLines(const char* path, std::vector<std::string>& lines) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return false;
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "\r\n")] = 0;
+    lines.push_back(line);
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool update = (argc == 3 && strcmp(argv[1], "--update") == 0);
+  if (argc != 2 && !update) {
+    fprintf(stderr, "usage: %s [--update] golden.csv\n", argv[0]);
+    return 2;
+  }
+  const char* goldenPath = argv[argc - 1];
+
+  std::vector<std::string> golden;
+  if (!update && !readLines(goldenPath, golden)) {
+    fprintf(stderr, "%s: cannot read (make update-golden creates it)\n", goldenPath);
+    return 2;
+  }
+
+  RenderConstants k;
+  FrameContext f;
+  beginSnapshots(k, f, snapshotLeds);
+
+  std::vector<std::string> results;
+  results.push_back("movingLength,additionalLEDs,gradientSoftness,centerShift,direction,background,distance,crc32");
+  uint32_t digest = 0;
+  int mismatches = 0;
+  float totalUs = 0;
+  printf("%s", SNAPSHOT_CSV_HEADER);
+  for (size_t n = 0; n < SNAPSHOT_CASES; n++) {
+    SnapshotCase c = snapshotCase(n);
+    float us;
+    uint32_t crc = renderSnapshot<HostClock>(c, k, f, us);
+    digest = crc32Update(digest, (const uint8_t*)&crc, sizeof(crc));
+    totalUs += us;
+
+    char line[96];
+    formatSnapshotLine(line, sizeof(line), c, crc, us);
+    printf("%s", line);
+    results.push_back(goldenLine(c, crc));
+    if (!update && (n + 1 >= golden.size() || golden[n + 1] != results.back())) {
+      fprintf(stderr, "MISMATCH case %u: expected %s, got %s\n", (unsigned)n,
+              n + 1 < golden.size() ? golden[n + 1].c_str() : "(missing)", results.back().c_str());
+      mismatches++;
+    }
+  }
+  char line[32];
+  snprintf(line, sizeof(line), "digest,%08x", (unsigned)digest);
+  results.push_back(line);
+  printf("%s\n", line);
+
+  if (update) {
+    FILE* file = fopen(goldenPath, "w");
+    if (file == NULL) {
+      fprintf(stderr, "%s: cannot write\n", goldenPath);
+      return 2;
+    }
+    for (size_t i = 0; i < results.size(); i++) fprintf(file, "%s\n", results[i].c_str());
+    fclose(file);
+    fprintf(stderr, "%u cases written to %s, digest %08x\n", (unsigned)SNAPSHOT_CASES, goldenPath, (unsigned)digest);
+    return 0;
+  }
+
+  if (golden.size() != results.size() || golden.back() != results.back()) mismatches++;
+  fprintf(stderr, "%u cases, %d mismatched, %.2f us per case on average, digest %08x\n",
+          (unsigned)SNAPSHOT_CASES, mismatches, totalUs / SNAPSHOT_CASES, (unsigned)digest);
+  return mismatches == 0 ? 0 : 1;
+}